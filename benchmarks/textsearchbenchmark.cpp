@@ -0,0 +1,153 @@
+// Times case-insensitive search over the text of a real document:
+// QString::contains() with Qt::CaseInsensitive, as search worked before
+// TextSearch, against TextSearch on text folded once up front, as
+// TextIndex keeps it, with every kernel the CPU supports.
+//
+// The document to search is named in DOCREADER_BENCH_DOCUMENT:
+//   DOCREADER_BENCH_DOCUMENT=manual.pdf bin/textsearchbenchmark
+// Any document with text will do; a .txt file is read as is, with form
+// feeds between pages.
+
+#include "document/documentfactory.h"
+#include "document/documentreader.h"
+#include "document/textsearch.h"
+#include <QFile>
+#include <QFileInfo>
+#include <QRegularExpression>
+#include <QStringList>
+#include <QTest>
+#include <memory>
+
+class TextSearchBenchmark : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+    void qstringContains_data();
+    void qstringContains();
+    void textSearch_data();
+    void textSearch();
+
+private:
+    void addTerms();
+    int qstringMatches(const QString& term) const;
+
+    QStringList m_pages;
+    QStringList m_foldedPages;
+};
+
+void TextSearchBenchmark::initTestCase()
+{
+    QString filePath = qEnvironmentVariable("DOCREADER_BENCH_DOCUMENT");
+    if (filePath.isEmpty()) {
+        QSKIP("Set DOCREADER_BENCH_DOCUMENT to a document to search");
+    }
+
+    if (QFileInfo(filePath).suffix().compare("txt", Qt::CaseInsensitive) == 0) {
+        QFile file(filePath);
+        QVERIFY2(file.open(QIODevice::ReadOnly | QIODevice::Text), qPrintable(file.errorString()));
+        m_pages = QString::fromUtf8(file.readAll()).split(u'\f');
+    } else {
+        std::unique_ptr<DocumentReader> reader = DocumentFactory::createReader(filePath);
+        QVERIFY2(reader, "Unsupported format");
+        reader->setBackgroundWork(false);
+        QVERIFY2(reader->load(filePath), "Failed to open");
+        QVERIFY2(reader->supportsTextExtraction(), "No text to search");
+        for (int i = 0; i < reader->pageCount(); ++i) {
+            m_pages.append(reader->extractText(i));
+        }
+    }
+
+    qsizetype characters = 0;
+    for (const QString& page : m_pages) {
+        m_foldedPages.append(page.toCaseFolded());
+        characters += page.size();
+    }
+    QVERIFY2(characters > 0, "The document has no text");
+    qInfo().noquote() << QStringLiteral("Searching %1 pages, %2 characters").arg(m_pages.size()).arg(characters);
+}
+
+void TextSearchBenchmark::addTerms()
+{
+    QTest::addColumn<QString>("term");
+
+    // A common word, a word and a phrase from the middle of the document
+    // in other case, and strings that occur nowhere, which scan everything
+    QTest::newRow("common") << "the";
+
+    QString middle = m_pages.value(m_pages.size() / 2);
+    QRegularExpressionMatch word = QRegularExpression("\\b\\w{8,}\\b").match(middle);
+    if (word.hasMatch()) {
+        QTest::newRow("word") << word.captured().toUpper();
+    }
+    QRegularExpressionMatch phrase = QRegularExpression("\\b\\w{3,}\\s\\w{3,}\\s\\w{3,}\\b").match(middle);
+    if (phrase.hasMatch()) {
+        QTest::newRow("phrase") << phrase.captured().toUpper();
+    }
+
+    QTest::newRow("absent") << "qzxjvk";
+    QTest::newRow("absent phrase") << "a phrase that does not occur in this document";
+}
+
+int TextSearchBenchmark::qstringMatches(const QString& term) const
+{
+    int matches = 0;
+    for (const QString& page : m_pages) {
+        if (page.contains(term, Qt::CaseInsensitive)) {
+            ++matches;
+        }
+    }
+    return matches;
+}
+
+void TextSearchBenchmark::qstringContains_data()
+{
+    addTerms();
+}
+
+void TextSearchBenchmark::qstringContains()
+{
+    QFETCH(QString, term);
+
+    QBENCHMARK {
+        qstringMatches(term);
+    }
+}
+
+void TextSearchBenchmark::textSearch_data()
+{
+    addTerms();
+}
+
+void TextSearchBenchmark::textSearch()
+{
+    QFETCH(QString, term);
+
+    // Each row runs under every kernel the CPU has, AVX2 only where present
+    QList<TextSearch::Kernel> kernels = {TextSearch::Kernel::Scalar, TextSearch::Kernel::SSE};
+    if (TextSearch::kernel() == TextSearch::Kernel::AVX2) {
+        kernels.append(TextSearch::Kernel::AVX2);
+    }
+
+    int expected = qstringMatches(term);
+    for (TextSearch::Kernel kernel : kernels) {
+        int matches = 0;
+        QBENCHMARK {
+            // The query is folded per search, the pages only once
+            QString needle = term.toCaseFolded();
+            const char16_t* needleData = reinterpret_cast<const char16_t*>(needle.utf16());
+            matches = 0;
+            for (const QString& page : m_foldedPages) {
+                if (TextSearch::indexOf(kernel, reinterpret_cast<const char16_t*>(page.utf16()), page.size(),
+                                        needleData, needle.size()) >= 0) {
+                    ++matches;
+                }
+            }
+        }
+        QCOMPARE(matches, expected);
+    }
+}
+
+QTEST_GUILESS_MAIN(TextSearchBenchmark)
+#include "textsearchbenchmark.moc"
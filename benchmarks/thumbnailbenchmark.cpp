@@ -0,0 +1,117 @@
+// Times thumbnail rendering of a real document and reports thumbnails per
+// second: the old path, rendering at THUMBNAIL_DPI and scaling the result
+// down smoothly, against DocumentReader::renderThumbnail(), which renders
+// at the size of the thumbnail in one pass. Both fill the same
+// THUMBNAIL_WIDTH x THUMBNAIL_HEIGHT box as the thumbnail panel.
+//
+// The document is named in DOCREADER_BENCH_DOCUMENT:
+//   DOCREADER_BENCH_DOCUMENT=manual.pdf bin/thumbnailbenchmark
+// Up to PAGE_LIMIT pages spread over the document are rendered, on one
+// thread, so the figures are per render thread.
+
+#include "config.h"
+#include "document/documentfactory.h"
+#include "document/documentreader.h"
+#include <QElapsedTimer>
+#include <QGuiApplication>
+#include <QImage>
+#include <QList>
+#include <QTest>
+#include <memory>
+
+class ThumbnailBenchmark : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void initTestCase();
+    void scaledRender();
+    void renderThumbnail();
+
+private:
+    void report(const char* path, qint64 thumbnails, qint64 nanoseconds) const;
+
+    static constexpr int PAGE_LIMIT = 50;
+
+    std::unique_ptr<DocumentReader> m_document;
+    QList<int> m_pages;
+};
+
+void ThumbnailBenchmark::initTestCase()
+{
+    QString filePath = qEnvironmentVariable("DOCREADER_BENCH_DOCUMENT");
+    if (filePath.isEmpty()) {
+        QSKIP("Set DOCREADER_BENCH_DOCUMENT to a document to render");
+    }
+
+    m_document = DocumentFactory::createReader(filePath);
+    QVERIFY2(m_document, "Unsupported format");
+    // Rendering is timed alone, without indexing or prefetching alongside
+    m_document->setBackgroundWork(false);
+    QVERIFY2(m_document->load(filePath), "Failed to open");
+
+    int pageCount = m_document->pageCount();
+    QVERIFY2(pageCount > 0, "The document has no pages");
+    int step = qMax(1, pageCount / PAGE_LIMIT);
+    for (int i = 0; i < pageCount && m_pages.size() < PAGE_LIMIT; i += step) {
+        m_pages.append(i);
+    }
+}
+
+void ThumbnailBenchmark::report(const char* path, qint64 thumbnails, qint64 nanoseconds) const
+{
+    double seconds = nanoseconds / 1e9;
+    qInfo().noquote() << QStringLiteral("%1: %2 thumbnails in %3 s (%4 thumbnails/s)")
+                             .arg(QString::fromLatin1(path))
+                             .arg(thumbnails)
+                             .arg(seconds, 0, 'f', 3)
+                             .arg(seconds > 0 ? thumbnails / seconds : 0.0, 0, 'f', 1);
+}
+
+void ThumbnailBenchmark::scaledRender()
+{
+    qint64 thumbnails = 0;
+    QElapsedTimer timer;
+    timer.start();
+    QBENCHMARK {
+        for (int pageIndex : m_pages) {
+            QImage image = m_document->renderImage(pageIndex, THUMBNAIL_DPI);
+            QImage thumbnail = image.scaled(THUMBNAIL_WIDTH, THUMBNAIL_HEIGHT, Qt::KeepAspectRatio,
+                                            Qt::SmoothTransformation);
+            QVERIFY(!thumbnail.isNull());
+            ++thumbnails;
+        }
+    }
+    report("Render at THUMBNAIL_DPI and scale", thumbnails, timer.nsecsElapsed());
+}
+
+void ThumbnailBenchmark::renderThumbnail()
+{
+    const QSize box(THUMBNAIL_WIDTH, THUMBNAIL_HEIGHT);
+    qint64 thumbnails = 0;
+    QElapsedTimer timer;
+    timer.start();
+    QBENCHMARK {
+        for (int pageIndex : m_pages) {
+            QImage thumbnail = m_document->renderThumbnail(pageIndex, box);
+            QVERIFY(!thumbnail.isNull());
+            QVERIFY(thumbnail.width() <= box.width() && thumbnail.height() <= box.height());
+            ++thumbnails;
+        }
+    }
+    report("renderThumbnail()", thumbnails, timer.nsecsElapsed());
+}
+
+int main(int argc, char* argv[])
+{
+    // Render without a display unless a platform was asked for
+    if (!qEnvironmentVariableIsSet("QT_QPA_PLATFORM")) {
+        qputenv("QT_QPA_PLATFORM", "offscreen");
+    }
+
+    QGuiApplication app(argc, argv);
+    ThumbnailBenchmark benchmark;
+    return QTest::qExec(&benchmark, argc, argv);
+}
+
+#include "thumbnailbenchmark.moc"
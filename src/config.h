@@ -25,5 +25,14 @@
 #define DEFAULT_ZOOM_FACTOR 1.0
 #define DEFAULT_DPI 96.0
 #define THUMBNAIL_DPI 36.0
+#define THUMBNAIL_WIDTH 120
+#define THUMBNAIL_HEIGHT 168 // Approximate page ratio
 #define MAX_ZOOM_FACTOR 10.0
 #define MIN_ZOOM_FACTOR 0.1
+
+// Rendering
+#define DEFAULT_RENDER_CACHE_MB 256
+#define THUMBNAIL_CACHE_MB 64
+#define THUMBNAIL_DISK_CACHE_MB 256
+#define IMAGE_PYRAMID_CACHE_MB 256
+#define THUMBNAIL_START_DELAY_MS 2000 // Thumbnails start by then even if the first page is slow
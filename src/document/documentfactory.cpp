@@ -1,6 +1,7 @@
 #include "documentfactory.h"
 #include "pdfreader.h"
 #include "imagereader.h"
+#include "svgreader.h"
 #include <QFileInfo>
 #include <QStringList>
 
@@ -12,12 +13,16 @@ std::unique_ptr<DocumentReader> DocumentFactory::createReader(const QString& fil
         return std::make_unique<PDFReader>();
     }
     
+    // Vector images are drawn at whatever resolution is asked for
+    if (extension == "svg" || extension == "svgz") {
+        return std::make_unique<SvgReader>();
+    }
+    
     // Image formats
     if (extension == "jpg" || extension == "jpeg" || 
         extension == "png" || extension == "bmp" || 
         extension == "gif" || extension == "tiff" || 
-        extension == "tif" || extension == "svg" ||
-        extension == "webp") {
+        extension == "tif" || extension == "webp") {
         return std::make_unique<ImageReader>();
     }
     
@@ -43,7 +48,7 @@ QStringList DocumentFactory::supportedExtensions()
 {
     return QStringList() << "pdf" 
                         << "jpg" << "jpeg" << "png" << "bmp" 
-                        << "gif" << "tiff" << "tif" << "svg" << "webp";
+                        << "gif" << "tiff" << "tif" << "svg" << "svgz" << "webp";
     
     // Future extensions will be added here:
     // return QStringList() << "pdf" << "docx" << "odt" << "epub" << "txt";
@@ -55,7 +60,7 @@ QString DocumentFactory::fileDialogFilter()
     
     // Add specific format filters
     filters << "PDF Documents (*.pdf)";
-    filters << "Image Files (*.jpg *.jpeg *.png *.bmp *.gif *.tiff *.tif *.svg *.webp)";
+    filters << "Image Files (*.jpg *.jpeg *.png *.bmp *.gif *.tiff *.tif *.svg *.svgz *.webp)";
     
     // Future formats:
     // filters << "Word Documents (*.docx)";
@@ -1,5 +1,90 @@
 #include "documentreader.h"
+#include "multipatternmatcher.h"
+#include <QMutexLocker>
+#include <algorithm>
 
-// This file contains the implementation of the DocumentReader base class.
-// Since it's an abstract class, there's no implementation needed here.
-// All methods are pure virtual and must be implemented by derived classes.
+QImage DocumentReader::renderThumbnail(int pageIndex, const QSize& box,
+                                       const std::atomic_bool* cancelled) const
+{
+    QSizeF size = pageSize(pageIndex);
+    if (size.isEmpty() || box.isEmpty()) {
+        return QImage();
+    }
+    
+    // Backends round the pixel size up; stay just below the exact fit so
+    // the result never exceeds the box
+    double scale = std::min(box.width() / size.width(), box.height() / size.height());
+    double dpi = 72.0 * scale * (1.0 - 1e-6);
+    
+    return renderImage(pageIndex, dpi, QRect(), cancelled);
+}
+
+void DocumentReader::setPageGeometryCallback(const std::function<void()>& callback)
+{
+    QMutexLocker locker(&m_callbackMutex);
+    m_pageGeometryCallback = callback;
+}
+
+void DocumentReader::notifyPageGeometryReady() const
+{
+    QMutexLocker locker(&m_callbackMutex);
+    if (m_pageGeometryCallback) {
+        m_pageGeometryCallback();
+    }
+}
+
+QList<QList<int>> DocumentReader::searchTerms(const QStringList& terms, bool caseSensitive) const
+{
+    QList<QList<int>> results(terms.size());
+    if (!isLoaded() || !supportsTextExtraction() || terms.isEmpty()) {
+        return results;
+    }
+    
+    QStringList patterns = terms;
+    if (!caseSensitive) {
+        for (QString& pattern : patterns) {
+            pattern = pattern.toCaseFolded();
+        }
+    }
+    MultiPatternMatcher matcher(patterns);
+    
+    int count = pageCount();
+    for (int i = 0; i < count; ++i) {
+        QString text = extractText(i);
+        if (!caseSensitive) {
+            text = text.toCaseFolded();
+        }
+        for (int term : matcher.findIn(text)) {
+            results[term].append(i);
+        }
+    }
+    return results;
+}
+
+QList<QList<int>> DocumentReader::searchRegularExpressions(const QList<QRegularExpression>& expressions) const
+{
+    QList<QList<int>> results(expressions.size());
+    if (!isLoaded() || !supportsTextExtraction() || expressions.isEmpty()) {
+        return results;
+    }
+    
+    // Compile up front rather than on the first page
+    QList<QRegularExpression> compiled = expressions;
+    for (QRegularExpression& expression : compiled) {
+        expression.optimize();
+    }
+    
+    int count = pageCount();
+    for (int i = 0; i < count; ++i) {
+        QString text = extractText(i);
+        if (text.isEmpty()) {
+            continue;
+        }
+        for (int e = 0; e < compiled.size(); ++e) {
+            if (compiled[e].isValid() && compiled[e].match(text).hasMatch()) {
+                results[e].append(i);
+            }
+        }
+    }
+    return results;
+}
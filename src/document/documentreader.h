@@ -2,9 +2,20 @@
 
 #include <QString>
 #include <QPixmap>
+#include <QImage>
 #include <QSizeF>
+#include <QRect>
+#include <QRectF>
+#include <QList>
+#include <QMutex>
+#include <QStringList>
+#include <QRegularExpression>
+#include <atomic>
+#include <functional>
 #include <memory>
 
+class MappedFile;
+
 /**
  * Abstract base class for document readers.
  * This class defines the interface that all document readers must implement.
@@ -13,6 +24,15 @@
 class DocumentReader
 {
 public:
+    /**
+     * A word of a page's text and where it sits on the page.
+     */
+    struct Word {
+        QString text;
+        QRectF rect;            // In points, from the top left of the page
+        bool spaceAfter = false; // Whether the text has a space after the word
+    };
+    
     virtual ~DocumentReader() = default;
     
     /**
@@ -33,6 +53,15 @@ public:
      */
     virtual bool isLoaded() const = 0;
     
+    /**
+     * Allow or prevent the background work load() starts for interactive
+     * use, such as indexing text, measuring every page or decoding pages
+     * ahead. Batch tools that visit each page once turn it off.
+     * Set before load().
+     */
+    void setBackgroundWork(bool enabled) { m_backgroundWork = enabled; }
+    bool backgroundWork() const { return m_backgroundWork; }
+    
     /**
      * Get the number of pages in the document.
      * @return Number of pages, or 0 if no document is loaded
@@ -47,6 +76,46 @@ public:
      */
     virtual QPixmap renderPage(int pageIndex, double dpi = 72.0) const = 0;
     
+    /**
+     * Render a specific page as a QImage.
+     * Unlike renderPage() this is safe to call from worker threads.
+     * @param pageIndex 0-based page index
+     * @param dpi Resolution for rendering (default: 72)
+     * @param region Part of the page to render, in pixels at the given DPI;
+     *        a null rect renders the whole page
+     * @param cancelled Optional flag; once it becomes true the render is
+     *        abandoned as soon as possible and a null image is returned
+     * @return Rendered page, or null image if page doesn't exist or the render was cancelled
+     */
+    virtual QImage renderImage(int pageIndex, double dpi = 72.0, const QRect& region = QRect(),
+                               const std::atomic_bool* cancelled = nullptr) const = 0;
+    
+    /**
+     * Render a page to fit inside a box of pixels, for thumbnails.
+     * The default implementation picks the DPI at which the page fills the
+     * box, so the backend produces the final bitmap in a single pass.
+     * Safe to call from worker threads.
+     * @param pageIndex 0-based page index
+     * @param box Maximum size of the result in pixels
+     * @param cancelled Optional flag; see renderImage()
+     * @return Rendered page, or null image on failure or cancellation
+     */
+    virtual QImage renderThumbnail(int pageIndex, const QSize& box,
+                                   const std::atomic_bool* cancelled = nullptr) const;
+    
+    /**
+     * Tell the reader a page is on screen at a resolution, so it can get
+     * the pages next to it ready in the background. Only a hint; the
+     * default does nothing.
+     * @param pageIndex 0-based page index
+     * @param dpi Resolution the page is shown at
+     */
+    virtual void pageShown(int pageIndex, double dpi) const
+    {
+        Q_UNUSED(pageIndex);
+        Q_UNUSED(dpi);
+    }
+    
     /**
      * Get the size of a specific page in points.
      * @param pageIndex 0-based page index
@@ -54,6 +123,38 @@ public:
      */
     virtual QSizeF pageSize(int pageIndex) const = 0;
     
+    /**
+     * Check whether the sizes of all pages are known without touching the
+     * document backend. Readers that measure pages in the background after
+     * load() return false until that is done; pageSize() still works then,
+     * but is slow.
+     * @return true if pageSize() is a cheap lookup
+     */
+    virtual bool pageGeometryReady() const { return true; }
+    
+    /**
+     * Set a function to call when pageGeometryReady() turns true, instead
+     * of asking again and again. It is called on the reader's background
+     * thread, so it should only post to the thread that wants to know.
+     * Never called by readers whose geometry is ready after load().
+     * @param callback Function to call, or an empty function to stop
+     */
+    void setPageGeometryCallback(const std::function<void()>& callback);
+    
+    /**
+     * Get the render hints that affect the output of renderPage().
+     * Used to key cached renders; readers without hints return 0.
+     * @return Reader-specific render hint flags
+     */
+    virtual int renderHints() const { return 0; }
+    
+    /**
+     * Get the memory mapping the document is read from, for other code
+     * that reads the same file (thumbnail fingerprints, for one).
+     * @return Shared mapping, or nullptr if the reader does not map its file
+     */
+    virtual std::shared_ptr<const MappedFile> mappedFile() const { return nullptr; }
+    
     /**
      * Get the document's metadata.
      * @return Document metadata (title, author, etc.)
@@ -83,6 +184,18 @@ public:
      */
     virtual QString extractText(int pageIndex) const = 0;
     
+    /**
+     * Extract the words of a page with their bounding boxes.
+     * Safe to call from worker threads.
+     * @param pageIndex 0-based page index
+     * @return Words in reading order, or an empty list if not supported or page doesn't exist
+     */
+    virtual QList<Word> extractWords(int pageIndex) const
+    {
+        Q_UNUSED(pageIndex);
+        return QList<Word>();
+    }
+    
     /**
      * Search for text in the document.
      * @param searchText Text to search for
@@ -90,4 +203,49 @@ public:
      * @return List of page indices where text was found
      */
     virtual QList<int> searchText(const QString& searchText, bool caseSensitive = false) const = 0;
+    
+    /**
+     * Search for several strings in a single pass over the document.
+     * Each page's text is scanned once whatever the number of terms.
+     * @param terms Strings to search for
+     * @param caseSensitive Whether search should be case sensitive
+     * @return For each term, in order, the page indices where it was found
+     */
+    virtual QList<QList<int>> searchTerms(const QStringList& terms, bool caseSensitive = false) const;
+    
+    /**
+     * Search for regular expressions in a single pass over the document.
+     * @param expressions Patterns to match; invalid ones match nothing
+     * @return For each expression, in order, the page indices where it matches
+     */
+    virtual QList<QList<int>> searchRegularExpressions(const QList<QRegularExpression>& expressions) const;
+    
+    /**
+     * Find every occurrence of a string on one page.
+     * Safe to call from worker threads. Readers without text return nothing.
+     * @param pageIndex 0-based page index
+     * @param searchText Text to search for
+     * @param caseSensitive Whether search should be case sensitive
+     * @return Rectangles of the hits in page points
+     */
+    virtual QList<QRectF> searchPage(int pageIndex, const QString& searchText, bool caseSensitive = false) const
+    {
+        Q_UNUSED(pageIndex);
+        Q_UNUSED(searchText);
+        Q_UNUSED(caseSensitive);
+        return QList<QRectF>();
+    }
+    
+protected:
+    /**
+     * Call the page geometry callback, if any. For readers whose
+     * pageGeometryReady() turns true after load().
+     */
+    void notifyPageGeometryReady() const;
+    
+    bool m_backgroundWork = true;
+    
+private:
+    mutable QMutex m_callbackMutex; // Held while calling, so clearing it waits for a call in progress
+    std::function<void()> m_pageGeometryCallback;
 };
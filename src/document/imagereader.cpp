@@ -1,67 +1,507 @@
 #include "imagereader.h"
+#include "mappedfile.h"
+#include "../config.h"
+#include <QDebug>
 #include <QFileInfo>
 #include <QImageReader>
+#include <QMutexLocker>
+#include <QPainter>
+#include <QRunnable>
+#include <QTemporaryFile>
+#include <algorithm>
+#include <cmath>
 
 ImageReader::ImageReader()
+    : m_randomAccess(true)
+    , m_scaledDecode(false)
+    , m_clipDecode(false)
+    , m_levelBytes(0)
+    , m_useCounter(0)
+    , m_spilledKey(-1, -1)
+    , m_sequentialNext(0)
+    , m_prefetchCancelled(false)
 {
+    m_prefetchPool.setMaxThreadCount(1);
+}
+
+ImageReader::~ImageReader()
+{
+    close(); // Prefetch workers use this reader
 }
 
 bool ImageReader::load(const QString& filePath)
 {
     close();
     
-    m_image.load(filePath);
-    if (m_image.isNull()) {
+    // The decoder reads the mapped file in place instead of through a
+    // QFile's read buffer; the mapping stays for the decodes to come
+    m_filePath = filePath;
+    m_file = MappedFile::open(filePath);
+    
+    // Only headers are read here; pixels are decoded when first rendered
+    std::unique_ptr<QBuffer> buffer;
+    QImageReader reader;
+    setUpReader(reader, buffer);
+    if (!reader.canRead()) {
+        close();
         return false;
     }
     
-    m_filePath = filePath;
+    QSize firstSize = reader.size();
+    int frameCount = std::max(1, reader.imageCount());
+    m_scaledDecode = reader.supportsOption(QImageIOHandler::ScaledSize);
+    m_clipDecode = reader.supportsOption(QImageIOHandler::ScaledClipRect);
+    m_frameSizes.assign(frameCount, firstSize);
+    m_randomAccess = true;
+    
+    if (frameCount > 1) {
+        // Animation frames share the canvas size; the pages of a TIFF can
+        // each have their own, read from each page's header
+        m_randomAccess = reader.jumpToImage(frameCount - 1);
+        if (m_randomAccess && !reader.supportsAnimation()) {
+            for (int i = 1; i < frameCount; ++i) {
+                if (reader.jumpToImage(i) && reader.size().isValid()) {
+                    m_frameSizes[i] = reader.size();
+                }
+            }
+        }
+    }
+    
+    if (!firstSize.isValid()) {
+        // The format only knows its size once decoded
+        QImage image = m_randomAccess ? decode(0, QSize()) : decodeSequential(0, nullptr);
+        if (image.isNull()) {
+            close();
+            return false;
+        }
+        for (QSize& size : m_frameSizes) {
+            if (!size.isValid()) {
+                size = image.size();
+            }
+        }
+        storeLevel(0, 0, image);
+    }
+    
     return true;
 }
 
 void ImageReader::close()
 {
+    m_prefetchCancelled = true;
+    m_prefetchPool.clear();
+    m_prefetchPool.waitForDone();
+    m_prefetchCancelled = false;
+    
     m_filePath.clear();
-    m_image = QPixmap();
+    m_frameSizes.clear();
+    m_randomAccess = true;
+    m_scaledDecode = false;
+    m_clipDecode = false;
+    
+    {
+        QMutexLocker locker(&m_sequentialMutex);
+        m_sequentialReader.reset();
+        m_sequentialBuffer.reset();
+        m_sequentialNext = 0;
+    }
+    {
+        QMutexLocker locker(&m_levelsMutex);
+        m_levels.clear();
+        m_levelBytes = 0;
+        m_spilledKey = {-1, -1};
+        m_spilledImage = QImage();
+        m_prefetching.clear();
+    }
+    
+    m_file.reset();
 }
 
 bool ImageReader::isLoaded() const
 {
-    return !m_image.isNull();
+    return !m_frameSizes.empty();
 }
 
 int ImageReader::pageCount() const
 {
-    return isLoaded() ? 1 : 0;
+    return static_cast<int>(m_frameSizes.size());
 }
 
 QPixmap ImageReader::renderPage(int pageIndex, double dpi) const
 {
-    if (!isLoaded() || pageIndex != 0) {
+    QImage image = renderImage(pageIndex, dpi);
+    if (image.isNull()) {
         return QPixmap();
     }
     
-    if (dpi == 72.0) {
-        return m_image;
+    return QPixmap::fromImage(image);
+}
+
+QImage ImageReader::renderImage(int pageIndex, double dpi, const QRect& region,
+                                const std::atomic_bool* cancelled) const
+{
+    if (pageIndex < 0 || pageIndex >= pageCount() || dpi <= 0 || (cancelled && cancelled->load())) {
+        return QImage();
     }
     
-    // Scale based on DPI
+    // One image pixel is one point; pick the smallest level that still has
+    // at least as many pixels as the output, so scaling only ever shrinks
+    // by less than half (or enlarges level 0)
+    const QSize& frameSize = m_frameSizes[pageIndex];
     double scaleFactor = dpi / 72.0;
-    return m_image.scaled(
-        static_cast<int>(m_image.width() * scaleFactor),
-        static_cast<int>(m_image.height() * scaleFactor),
-        Qt::KeepAspectRatio,
-        Qt::SmoothTransformation
-    );
+    int level = levelFor(pageIndex, scaleFactor);
+    QSize size = levelSize(pageIndex, level);
+    double levelScale = static_cast<double>(size.width()) / frameSize.width();
+    double factor = scaleFactor / levelScale;
+    
+    if (!region.isNull()) {
+        // Scale only the source pixels under the requested tile, plus one
+        // around them for the filter to read
+        QRectF source(region.x() / factor, region.y() / factor,
+                      region.width() / factor, region.height() / factor);
+        QRect sourceRect = source.toAlignedRect().adjusted(-1, -1, 1, 1).intersected(QRect(QPoint(0, 0), size));
+        if (sourceRect.isEmpty()) {
+            return QImage();
+        }
+        
+        QImage part;
+        if (isHuge(size) && m_clipDecode && m_randomAccess && !hasLevel(pageIndex, level)) {
+            part = decode(pageIndex, size, sourceRect);
+        } else {
+            part = levelImage(pageIndex, level, cancelled).copy(sourceRect);
+        }
+        if (part.isNull() || (cancelled && cancelled->load())) {
+            return QImage();
+        }
+        
+        // The sub-pixel source rectangle is mapped onto exactly the region,
+        // so the tile has the requested size and lines up with its
+        // neighbours; past the edge of the image it stays transparent
+        QImage tile(region.size(), QImage::Format_ARGB32_Premultiplied);
+        tile.fill(Qt::transparent);
+        QPainter painter(&tile);
+        painter.setRenderHint(QPainter::SmoothPixmapTransform);
+        painter.drawImage(QRectF(QPointF(0, 0), QSizeF(region.size())), part,
+                          source.translated(-sourceRect.topLeft()));
+        return tile;
+    }
+    
+    QImage image = levelImage(pageIndex, level, cancelled);
+    if (image.isNull() || (cancelled && cancelled->load())) {
+        return QImage();
+    }
+    
+    QSize target(static_cast<int>(frameSize.width() * scaleFactor),
+                 static_cast<int>(frameSize.height() * scaleFactor));
+    if (target.isEmpty() || image.size() == target) {
+        return image;
+    }
+    return image.scaled(target, Qt::KeepAspectRatio, Qt::SmoothTransformation);
+}
+
+QImage ImageReader::renderThumbnail(int pageIndex, const QSize& box,
+                                    const std::atomic_bool* cancelled) const
+{
+    if (pageIndex < 0 || pageIndex >= pageCount() || box.isEmpty() || (cancelled && cancelled->load())) {
+        return QImage();
+    }
+    
+    // Decoders that support it (JPEG in particular) decode straight at the
+    // reduced size, which is far cheaper than scaling the full image
+    const QSize& frameSize = m_frameSizes[pageIndex];
+    QSize target = frameSize.scaled(box, Qt::KeepAspectRatio);
+    if (m_scaledDecode && m_randomAccess) {
+        QImage image = decode(pageIndex, target);
+        if (!image.isNull()) {
+            return image;
+        }
+    }
+    
+    int level = levelFor(pageIndex, static_cast<double>(target.width()) / frameSize.width());
+    QImage image = levelImage(pageIndex, level, cancelled);
+    if (image.isNull()) {
+        return QImage();
+    }
+    return image.scaled(target, Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
+}
+
+void ImageReader::pageShown(int pageIndex, double dpi) const
+{
+    if (pageIndex < 0 || pageIndex >= pageCount() || dpi <= 0) {
+        return;
+    }
+    
+    prefetchNeighbours(pageIndex, dpi / 72.0);
 }
 
 QSizeF ImageReader::pageSize(int pageIndex) const
 {
-    if (!isLoaded() || pageIndex != 0) {
+    if (pageIndex < 0 || pageIndex >= pageCount()) {
         return QSizeF();
     }
     
-    return m_image.size();
+    return m_frameSizes[pageIndex];
+}
+
+QImage ImageReader::decode(int frame, const QSize& size, const QRect& clip) const
+{
+    std::unique_ptr<QBuffer> buffer;
+    QImageReader reader;
+    setUpReader(reader, buffer);
+    if (frame > 0 && !reader.jumpToImage(frame)) {
+        qWarning() << "Cannot seek to frame" << frame << "of" << m_filePath;
+        return QImage();
+    }
+    if (size.isValid() && size != m_frameSizes[frame]) {
+        reader.setScaledSize(size);
+    }
+    if (!clip.isNull()) {
+        reader.setScaledClipRect(clip);
+    }
+    
+    QImage image = reader.read();
+    if (image.isNull()) {
+        qWarning() << "Failed to decode image:" << m_filePath << reader.errorString();
+    }
+    return image;
+}
+
+QImage ImageReader::decodeSequential(int frame, const std::atomic_bool* cancelled) const
+{
+    QMutexLocker locker(&m_sequentialMutex);
+    
+    // Going back means starting over from the first frame
+    if (!m_sequentialReader || m_sequentialNext > frame) {
+        m_sequentialReader = std::make_unique<QImageReader>();
+        setUpReader(*m_sequentialReader, m_sequentialBuffer);
+        m_sequentialNext = 0;
+    }
+    
+    QImage image;
+    while (m_sequentialNext <= frame) {
+        if (cancelled && cancelled->load()) {
+            return QImage(); // The reader stays valid where it stopped
+        }
+        
+        image = m_sequentialReader->read();
+        if (image.isNull()) {
+            qWarning() << "Failed to decode frame" << m_sequentialNext << "of" << m_filePath
+                       << m_sequentialReader->errorString();
+            m_sequentialReader.reset();
+            m_sequentialBuffer.reset();
+            return QImage();
+        }
+        
+        // The frame just before the requested one is the likely next
+        // request when paging backwards; keep it rather than start over,
+        // unless it is too large to cache
+        if (m_sequentialNext == frame - 1 && !isHuge(image.size())) {
+            storeLevel(m_sequentialNext, 0, image);
+        }
+        ++m_sequentialNext;
+    }
+    return image;
+}
+
+int ImageReader::levelCount(int frame) const
+{
+    int count = 1;
+    const QSize& size = m_frameSizes[frame];
+    int edge = std::max(size.width(), size.height());
+    while ((edge >> count) >= MIN_LEVEL_EDGE) {
+        ++count;
+    }
+    return count;
+}
+
+QSize ImageReader::levelSize(int frame, int level) const
+{
+    const QSize& size = m_frameSizes[frame];
+    double divisor = std::ldexp(1.0, level);
+    return QSize(std::max(1, static_cast<int>(std::ceil(size.width() / divisor))),
+                 std::max(1, static_cast<int>(std::ceil(size.height() / divisor))));
+}
+
+int ImageReader::levelFor(int frame, double scale) const
+{
+    int level = 0;
+    int count = levelCount(frame);
+    while (level + 1 < count && std::ldexp(1.0, -(level + 1)) >= scale) {
+        ++level;
+    }
+    return level;
+}
+
+bool ImageReader::isHuge(const QSize& size) const
+{
+    return static_cast<qint64>(size.width()) * size.height() > HUGE_IMAGE_PIXELS;
+}
+
+bool ImageReader::hasLevel(int frame, int level) const
+{
+    QMutexLocker locker(&m_levelsMutex);
+    return m_levels.count({frame, level}) > 0 || m_spilledKey == std::make_pair(frame, level);
+}
+
+QImage ImageReader::levelImage(int frame, int level, const std::atomic_bool* cancelled) const
+{
+    std::pair<int, int> key(frame, level);
+    {
+        QMutexLocker locker(&m_levelsMutex);
+        // Workers rendering tiles of the same page all want the same level
+        // at once; one decodes it and the others wait for the result rather
+        // than each decoding the whole frame
+        while (m_decoding.count(key) > 0) {
+            m_levelDecoded.wait(&m_levelsMutex);
+        }
+        
+        auto it = m_levels.find(key);
+        if (it != m_levels.end()) {
+            it->second.lastUse = ++m_useCounter;
+            return it->second.image;
+        }
+        if (m_spilledKey == key) {
+            return m_spilledImage;
+        }
+        
+        if (cancelled && cancelled->load()) {
+            return QImage();
+        }
+        m_decoding.insert(key);
+    }
+    
+    // Decoded without holding the lock. Coarser levels are made from finer
+    // ones, so waiting only ever goes towards level 0 and cannot deadlock.
+    QImage image;
+    if (level == 0) {
+        image = m_randomAccess ? decode(frame, levelSize(frame, 0)) : decodeSequential(frame, cancelled);
+    } else if (m_scaledDecode && m_randomAccess) {
+        image = decode(frame, levelSize(frame, level));
+    } else {
+        QImage finer = levelImage(frame, level - 1, cancelled);
+        if (!finer.isNull()) {
+            image = finer.scaled(levelSize(frame, level), Qt::IgnoreAspectRatio, Qt::SmoothTransformation);
+        }
+    }
+    
+    if (!image.isNull()) {
+        storeLevel(frame, level, image);
+    }
+    
+    QMutexLocker locker(&m_levelsMutex);
+    m_decoding.erase(key);
+    m_levelDecoded.wakeAll();
+    return image;
+}
+
+void ImageReader::storeLevel(int frame, int level, const QImage& image) const
+{
+    qint64 budget = static_cast<qint64>(IMAGE_PYRAMID_CACHE_MB) * 1024 * 1024;
+    qint64 cost = image.sizeInBytes();
+    if (cost > budget) {
+        // Without a decoder that can decode a region, every tile of a huge
+        // image needs this level; keep the last such level on disk rather
+        // than decode the whole image again for each tile
+        QImage spilled = spill(image);
+        QMutexLocker locker(&m_levelsMutex);
+        m_spilledKey = {frame, level};
+        m_spilledImage = spilled;
+        return;
+    }
+    
+    QMutexLocker locker(&m_levelsMutex);
+    if (m_levels.count({frame, level}) > 0) {
+        return;
+    }
+    
+    while (m_levelBytes + cost > budget && !m_levels.empty()) {
+        auto oldest = std::min_element(m_levels.begin(), m_levels.end(), [](const auto& a, const auto& b) {
+            return a.second.lastUse < b.second.lastUse;
+        });
+        m_levelBytes -= oldest->second.image.sizeInBytes();
+        m_levels.erase(oldest);
+    }
+    
+    m_levels[{frame, level}] = CachedLevel{image, ++m_useCounter};
+    m_levelBytes += cost;
+}
+
+QImage ImageReader::spill(const QImage& image) const
+{
+    // Mapped pixels are read-only, and an indexed image's colour table
+    // could not be set on them without copying them back into memory
+    QImage source = image.colorCount() > 0
+        ? image.convertToFormat(image.hasAlphaChannel() ? QImage::Format_ARGB32 : QImage::Format_RGB32)
+        : image;
+    
+    auto file = std::make_unique<QTemporaryFile>();
+    qint64 bytes = source.sizeInBytes();
+    if (!file->open() || file->write(reinterpret_cast<const char*>(source.constBits()), bytes) != bytes) {
+        qWarning() << "Cannot keep decoded image in a temporary file:" << file->errorString();
+        return image; // Kept in memory instead
+    }
+    const uchar* data = file->map(0, bytes);
+    if (!data) {
+        qWarning() << "Cannot map decoded image:" << file->errorString();
+        return image;
+    }
+    
+    // The file, and with it the mapping, goes with the last copy of the image
+    QImage mapped(data, source.width(), source.height(), source.bytesPerLine(), source.format(),
+                  [](void* info) { delete static_cast<QTemporaryFile*>(info); }, file.get());
+    file.release();
+    return mapped;
+}
+
+void ImageReader::prefetchNeighbours(int frame, double scale) const
+{
+    if (pageCount() < 2 || !m_backgroundWork || m_prefetchCancelled) {
+        return;
+    }
+    
+    // Forward first; that is where readers usually go next. Formats read
+    // front to back keep the previous frame while passing it anyway.
+    for (int neighbour : {frame + 1, frame - 1}) {
+        if (neighbour < 0 || neighbour >= pageCount() || (neighbour < frame && !m_randomAccess)) {
+            continue;
+        }
+        
+        // The level the neighbour would be shown at; one too large for the
+        // cache would be decoded only to be thrown away
+        int level = levelFor(neighbour, scale);
+        if (isHuge(levelSize(neighbour, level))) {
+            continue;
+        }
+        {
+            QMutexLocker locker(&m_levelsMutex);
+            if (m_levels.count({neighbour, level}) > 0 || !m_prefetching.insert(neighbour).second) {
+                continue;
+            }
+        }
+        m_prefetchPool.start(QRunnable::create([this, neighbour, level]() {
+            levelImage(neighbour, level, &m_prefetchCancelled);
+            QMutexLocker locker(&m_levelsMutex);
+            m_prefetching.erase(neighbour);
+        }));
+    }
+}
+
+std::shared_ptr<const MappedFile> ImageReader::mappedFile() const
+{
+    return m_file;
+}
+
+void ImageReader::setUpReader(QImageReader& reader, std::unique_ptr<QBuffer>& buffer) const
+{
+    if (!m_file) {
+        reader.setFileName(m_filePath);
+        return;
+    }
+    
+    // The suffix is only a hint; the content decides if it is wrong, just
+    // as when reading from the file
+    buffer = m_file->device();
+    reader.setDevice(buffer.get());
+    reader.setFormat(QFileInfo(m_filePath).suffix().toLower().toLatin1());
 }
 
 QString ImageReader::title() const
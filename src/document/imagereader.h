@@ -2,16 +2,43 @@
 
 #include "documentreader.h"
 #include <QPixmap>
+#include <QImage>
+#include <QBuffer>
+#include <QImageReader>
+#include <QMutex>
+#include <QThreadPool>
+#include <QWaitCondition>
+#include <map>
+#include <set>
+#include <utility>
+#include <vector>
 
 /**
  * Image document reader implementation for common image formats.
  * Supports JPEG, PNG, BMP, GIF, and other Qt-supported formats.
+ *
+ * load() only reads the image header. Pixels are decoded on demand into a
+ * resolution pyramid, each level half the size of the one above, and every
+ * render is served from the smallest level that is at least as large as
+ * requested. Formats whose decoder can scale (JPEG) decode each level
+ * directly at its size; the others decode the full image once and halve it.
+ * For huge images whose decoder can decode a region, tiles are decoded on
+ * their own and the full-size image never has to be in memory. A level too
+ * large for the cache is decoded once and kept in a mapped temporary file,
+ * from which tiles are cut.
+ *
+ * Every frame of a multi-frame file (multi-page TIFF, animated GIF or
+ * WebP) is a page. Frames are decoded one at a time, by jumping to them
+ * where the format allows it and by reading on from the last frame read
+ * where it doesn't, and the frames next to the one on screen are decoded
+ * in the background at the level it is shown at. All frames share one
+ * bounded cache.
  */
 class ImageReader : public DocumentReader
 {
 public:
     ImageReader();
-    ~ImageReader() override = default;
+    ~ImageReader() override;
     
     // DocumentReader interface implementation
     bool load(const QString& filePath) override;
@@ -19,7 +46,13 @@ public:
     bool isLoaded() const override;
     int pageCount() const override;
     QPixmap renderPage(int pageIndex, double dpi = 72.0) const override;
+    QImage renderImage(int pageIndex, double dpi = 72.0, const QRect& region = QRect(),
+                       const std::atomic_bool* cancelled = nullptr) const override;
+    QImage renderThumbnail(int pageIndex, const QSize& box,
+                           const std::atomic_bool* cancelled = nullptr) const override;
+    void pageShown(int pageIndex, double dpi) const override;
     QSizeF pageSize(int pageIndex) const override;
+    std::shared_ptr<const MappedFile> mappedFile() const override;
     
     QString title() const override;
     QString author() const override;
@@ -33,6 +66,68 @@ public:
     QList<int> searchText(const QString& searchText, bool caseSensitive = false) const override;
     
 private:
+    // Points a reader at the mapped file, or at the file itself if it could
+    // not be mapped; buffer keeps the device alive while the reader is used
+    void setUpReader(QImageReader& reader, std::unique_ptr<QBuffer>& buffer) const;
+    
+    // Decodes a frame scaled to size, or only the part of it under clip
+    // (in scaled coordinates)
+    QImage decode(int frame, const QSize& size, const QRect& clip = QRect()) const;
+    
+    // Decodes a frame of a format that can only be read front to back
+    QImage decodeSequential(int frame, const std::atomic_bool* cancelled) const;
+    
+    // Pyramid levels of a frame; level 0 is the full frame
+    int levelCount(int frame) const;
+    QSize levelSize(int frame, int level) const;
+    int levelFor(int frame, double scale) const;
+    bool isHuge(const QSize& size) const;
+    bool hasLevel(int frame, int level) const;
+    QImage levelImage(int frame, int level, const std::atomic_bool* cancelled) const;
+    void storeLevel(int frame, int level, const QImage& image) const;
+    QImage spill(const QImage& image) const;
+    void prefetchNeighbours(int frame, double scale) const;
+    
     QString m_filePath;
-    QPixmap m_image;
+    std::shared_ptr<const MappedFile> m_file;
+    std::vector<QSize> m_frameSizes; // One per page
+    bool m_randomAccess; // Decoder can jump to any frame
+    bool m_scaledDecode; // Decoder scales while decoding; levels are decoded directly
+    bool m_clipDecode;   // Decoder can decode a region; huge images are served in tiles
+    
+    // Decoded levels by (frame, level), evicted least recently used first
+    // once they exceed IMAGE_PYRAMID_CACHE_MB. Filled from render worker
+    // threads; a level being decoded is waited for rather than decoded
+    // again by another worker.
+    struct CachedLevel {
+        QImage image; // QImage rather than QPixmap so workers can scale it
+        quint64 lastUse;
+    };
+    mutable QMutex m_levelsMutex;
+    mutable QWaitCondition m_levelDecoded;
+    mutable std::map<std::pair<int, int>, CachedLevel> m_levels;
+    mutable std::set<std::pair<int, int>> m_decoding;
+    mutable qint64 m_levelBytes;
+    mutable quint64 m_useCounter;
+    
+    // The last level too large for the cache, over a mapped temporary file
+    // that lives as long as the image does. Outside the cache budget: its
+    // pages are the OS's to drop and read back. Guarded by m_levelsMutex.
+    mutable std::pair<int, int> m_spilledKey;
+    mutable QImage m_spilledImage;
+    
+    // Reader kept open between calls for formats without random access,
+    // so decoding the next frame continues where the last one ended
+    mutable QMutex m_sequentialMutex;
+    mutable std::unique_ptr<QBuffer> m_sequentialBuffer;
+    mutable std::unique_ptr<QImageReader> m_sequentialReader;
+    mutable int m_sequentialNext; // Frame the reader returns next
+    
+    // Background decoding of the frames next to the one rendered
+    mutable QThreadPool m_prefetchPool;
+    mutable std::set<int> m_prefetching; // Guarded by m_levelsMutex
+    std::atomic_bool m_prefetchCancelled;
+    
+    static constexpr int MIN_LEVEL_EDGE = 64;              // Smallest level's longer edge
+    static constexpr qint64 HUGE_IMAGE_PIXELS = 64LL << 20; // Decoded in tiles beyond this
 };
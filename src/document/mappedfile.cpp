@@ -0,0 +1,101 @@
+#include "mappedfile.h"
+#include <QDir>
+#include <QFileInfo>
+#include <QList>
+#include <QStorageInfo>
+
+#ifdef Q_OS_WIN
+#include <windows.h>
+#endif
+
+namespace {
+
+// Files on these can be truncated by another machine while they are mapped,
+// which the mapping would turn into a crash on the next read
+bool isOnNetworkFileSystem(const QString& filePath)
+{
+    QStorageInfo storage(filePath);
+#ifdef Q_OS_WIN
+    QString root = storage.isValid() ? storage.rootPath() : filePath;
+    if (root.startsWith(QLatin1String("//")) || root.startsWith(QLatin1String("\\\\"))) {
+        return true; // UNC path
+    }
+    return GetDriveTypeW(reinterpret_cast<const wchar_t*>(QDir::toNativeSeparators(root).utf16())) == DRIVE_REMOTE;
+#else
+    static const QList<QByteArray> networkTypes = {
+        "nfs", "nfs4", "cifs", "smb2", "smb3", "smbfs", "afpfs", "webdav", "afs", "9p",
+        "ncpfs", "ceph", "glusterfs", "fuse.glusterfs", "fuse.sshfs", "fuse.rclone", "lustre", "gpfs"
+    };
+    return storage.isValid() && networkTypes.contains(storage.fileSystemType());
+#endif
+}
+
+} // namespace
+
+std::shared_ptr<const MappedFile> MappedFile::open(const QString& filePath)
+{
+    if (isOnNetworkFileSystem(filePath)) {
+        return nullptr; // Callers read the file the ordinary way instead
+    }
+
+    std::shared_ptr<MappedFile> mapped(new MappedFile());
+    mapped->m_file.setFileName(filePath);
+    if (!mapped->m_file.open(QIODevice::ReadOnly)) {
+        return nullptr;
+    }
+
+    mapped->m_size = mapped->m_file.size();
+    if (mapped->m_size <= 0) {
+        return nullptr;
+    }
+
+    mapped->m_data = mapped->m_file.map(0, mapped->m_size);
+    if (!mapped->m_data) {
+        return nullptr; // Callers fall back to reading the file
+    }
+
+    mapped->m_lastModified = QFileInfo(mapped->m_file).lastModified();
+    return mapped;
+}
+
+MappedFile::~MappedFile()
+{
+    if (m_data) {
+        m_file.unmap(m_data);
+    }
+}
+
+QString MappedFile::filePath() const
+{
+    return m_file.fileName();
+}
+
+qint64 MappedFile::size() const
+{
+    return m_size;
+}
+
+QDateTime MappedFile::lastModified() const
+{
+    return m_lastModified;
+}
+
+const uchar* MappedFile::data() const
+{
+    return m_data;
+}
+
+QByteArray MappedFile::bytes() const
+{
+    return QByteArray::fromRawData(reinterpret_cast<const char*>(m_data), static_cast<qsizetype>(m_size));
+}
+
+std::unique_ptr<QBuffer> MappedFile::device() const
+{
+    // QBuffer only reads through constData(), so the array is never
+    // detached and the mapping is read in place
+    auto buffer = std::make_unique<QBuffer>();
+    buffer->setData(bytes());
+    buffer->open(QIODevice::ReadOnly);
+    return buffer;
+}
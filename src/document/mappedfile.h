@@ -0,0 +1,73 @@
+#pragma once
+
+#include <QBuffer>
+#include <QByteArray>
+#include <QDateTime>
+#include <QFile>
+#include <QString>
+#include <memory>
+
+/**
+ * A document file mapped into memory once and shared by everything that
+ * reads it: the reader itself, its pool of document handles and the
+ * thumbnail fingerprint.
+ *
+ * The bytes are never copied. Pages of the file are faulted in from the
+ * OS page cache as they are touched, so reopening a recently used file
+ * costs no I/O and only the parts actually read become resident.
+ *
+ * The mapping is read-only and immutable, so it may be used from any
+ * number of threads; each user needs its own device() though, since a
+ * QIODevice has a read position.
+ *
+ * A mapped file must not shrink while it is mapped: reading a page that
+ * is no longer backed by the file raises SIGBUS on POSIX systems and an
+ * in-page error on Windows. Files are therefore not mapped on network file
+ * systems, where another machine can truncate or rewrite them at any time;
+ * open() returns nullptr and callers read them the ordinary way. Locally,
+ * Windows refuses to truncate a mapped file, and on POSIX systems a file
+ * replaced by rename, as editors and downloads do, leaves the mapping on
+ * the old contents. Only truncating the file in place is unsafe there.
+ */
+class MappedFile
+{
+public:
+    /**
+     * Map a file.
+     * @param filePath File to map
+     * @return The mapping, or nullptr if the file cannot be mapped (missing,
+     *         empty, on a network file system, or on a file system without
+     *         mmap support)
+     */
+    static std::shared_ptr<const MappedFile> open(const QString& filePath);
+
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    QString filePath() const;
+    qint64 size() const;
+    QDateTime lastModified() const;
+    const uchar* data() const;
+
+    /**
+     * The mapped bytes as a QByteArray that does not own them. Only use
+     * its const members; anything that detaches it copies the whole file.
+     */
+    QByteArray bytes() const;
+
+    /**
+     * A read-only device over the mapping, for APIs that read through a
+     * QIODevice. Must not outlive the mapping.
+     */
+    std::unique_ptr<QBuffer> device() const;
+
+private:
+    MappedFile() = default;
+
+    QFile m_file; // Closing the file would unmap it
+    uchar* m_data = nullptr;
+    qint64 m_size = 0;
+    QDateTime m_lastModified;
+};
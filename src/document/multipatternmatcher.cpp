@@ -0,0 +1,103 @@
+#include "multipatternmatcher.h"
+#include <deque>
+
+MultiPatternMatcher::MultiPatternMatcher(const QStringList& patterns)
+    : m_patternCount(static_cast<int>(patterns.size()))
+    , m_matchableCount(0)
+    , m_classCount(1)
+    , m_classOf(0x10000, 0)
+{
+    for (const QString& pattern : patterns) {
+        for (QChar c : pattern) {
+            quint16& cls = m_classOf[c.unicode()];
+            if (cls == 0) {
+                cls = static_cast<quint16>(m_classCount++);
+            }
+        }
+    }
+
+    // Trie of the patterns; -1 marks a missing edge until the links below
+    // fill it in
+    m_next.assign(m_classCount, -1);
+    m_outputs.resize(1);
+    for (int i = 0; i < m_patternCount; ++i) {
+        const QString& pattern = patterns[i];
+        if (pattern.isEmpty()) {
+            continue;
+        }
+        int state = 0;
+        for (QChar c : pattern) {
+            int& edge = m_next[static_cast<size_t>(state) * m_classCount + m_classOf[c.unicode()]];
+            if (edge < 0) {
+                edge = static_cast<int>(m_outputs.size());
+                m_outputs.emplace_back();
+                m_next.resize(m_next.size() + m_classCount, -1);
+            }
+            state = m_next[static_cast<size_t>(state) * m_classCount + m_classOf[c.unicode()]];
+        }
+        m_outputs[state].push_back(i);
+        ++m_matchableCount;
+    }
+
+    // Breadth first, turn missing edges into the edges of the longest
+    // proper suffix that is in the trie, so matching never backtracks
+    std::vector<int> fail(m_outputs.size(), 0);
+    std::deque<int> queue;
+    for (int cls = 0; cls < m_classCount; ++cls) {
+        int& edge = m_next[cls];
+        if (edge < 0) {
+            edge = 0;
+        } else {
+            queue.push_back(edge);
+        }
+    }
+    while (!queue.empty()) {
+        int state = queue.front();
+        queue.pop_front();
+        m_outputs[state].insert(m_outputs[state].end(),
+                                m_outputs[fail[state]].begin(), m_outputs[fail[state]].end());
+
+        for (int cls = 0; cls < m_classCount; ++cls) {
+            int& edge = m_next[static_cast<size_t>(state) * m_classCount + cls];
+            int fallback = m_next[static_cast<size_t>(fail[state]) * m_classCount + cls];
+            if (edge < 0) {
+                edge = fallback;
+            } else {
+                fail[edge] = fallback;
+                queue.push_back(edge);
+            }
+        }
+    }
+}
+
+int MultiPatternMatcher::patternCount() const
+{
+    return m_patternCount;
+}
+
+QList<int> MultiPatternMatcher::findIn(const QString& text) const
+{
+    std::vector<bool> found(m_patternCount, false);
+    int remaining = m_matchableCount;
+
+    const char16_t* units = reinterpret_cast<const char16_t*>(text.utf16());
+    const qsizetype size = text.size();
+    int state = 0;
+    for (qsizetype i = 0; i < size && remaining > 0; ++i) {
+        state = m_next[static_cast<size_t>(state) * m_classCount + m_classOf[units[i]]];
+        for (int pattern : m_outputs[state]) {
+            if (!found[pattern]) {
+                found[pattern] = true;
+                --remaining;
+            }
+        }
+    }
+
+    QList<int> patterns;
+    for (int i = 0; i < m_patternCount; ++i) {
+        if (found[i]) {
+            patterns.append(i);
+        }
+    }
+    return patterns;
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <QList>
+#include <QString>
+#include <QStringList>
+#include <QtGlobal>
+#include <vector>
+
+/**
+ * Finds which of a set of strings occur in a text, in one pass over the
+ * text however many strings there are (Aho-Corasick).
+ *
+ * The strings are compiled into a table-driven automaton that reads one
+ * UTF-16 code unit per step. Code units are mapped to classes first, one
+ * per distinct unit used by the patterns plus one for all others, which
+ * keeps the table small. Matching is exact; for a case-insensitive search,
+ * build from folded strings and match folded text.
+ *
+ * Immutable once built, so one matcher can be used from several threads.
+ */
+class MultiPatternMatcher
+{
+public:
+    /**
+     * Build the automaton.
+     * @param patterns Strings to find; empty ones never match
+     */
+    explicit MultiPatternMatcher(const QStringList& patterns);
+
+    int patternCount() const;
+
+    /**
+     * Find the patterns occurring in a text.
+     * @param text Text to scan
+     * @return Ascending indices of the patterns found
+     */
+    QList<int> findIn(const QString& text) const;
+
+private:
+    int m_patternCount;
+    int m_matchableCount; // Non-empty patterns; scanning stops once all are found
+    int m_classCount;
+    std::vector<quint16> m_classOf;          // Code unit -> class, 0 for units in no pattern
+    std::vector<int> m_next;                 // State * m_classCount + class -> state
+    std::vector<std::vector<int>> m_outputs; // State -> patterns ending there, via suffixes too
+};
@@ -1,11 +1,54 @@
 #include "pdfreader.h"
+#include "mappedfile.h"
+#include "multipatternmatcher.h"
+#include "textsearch.h"
 #include <QFile>
 #include <QFileInfo>
 #include <QDebug>
 #include <poppler-qt6.h>
+#include <algorithm>
+#include <mutex>
+#include <vector>
+
+namespace {
+
+bool shouldAbortRender(const QVariant& payload)
+{
+    auto* cancelled = reinterpret_cast<const std::atomic_bool*>(payload.value<quintptr>());
+    return cancelled && cancelled->load();
+}
+
+// Poppler only rasterizes the requested sub-rectangle, so tiles of a huge
+// page cost no more than the tile itself. It polls the abort callback while
+// rasterizing, so a cancelled job gives up its document early.
+QImage renderPopplerPage(const Poppler::Page* page, double dpi, const QRect& region,
+                         const std::atomic_bool* cancelled)
+{
+    int x = -1, y = -1, w = -1, h = -1;
+    if (!region.isNull()) {
+        x = region.x();
+        y = region.y();
+        w = region.width();
+        h = region.height();
+    }
+    
+    return page->renderToImage(dpi, dpi, x, y, w, h, Poppler::Page::Rotate0,
+                               nullptr, nullptr,
+                               cancelled ? shouldAbortRender : nullptr,
+                               QVariant::fromValue(reinterpret_cast<quintptr>(cancelled)));
+}
+
+} // namespace
 
 PDFReader::PDFReader()
     : m_document(nullptr)
+    , m_loaded(false)
+    , m_pageCount(0)
+    , m_renderHints(0)
+    , m_queryPool(1)
+    , m_geometryReady(false)
+    , m_geometryCancelled(false)
+    , m_textIndexCancelled(false)
 {
 }
 
@@ -23,9 +66,20 @@ bool PDFReader::load(const QString& filePath)
         return false;
     }
     
-    m_document = std::unique_ptr<Poppler::Document>(
-        Poppler::Document::load(filePath)
-    );
+    QMutexLocker locker(&m_mutex);
+    
+    // Poppler reads the mapped file in place through a QBuffer, so the file
+    // is never copied onto the heap and a file still in the OS page cache
+    // opens without I/O. loadFromData() would not do: it keeps a writable
+    // copy of the array, which deep-copies raw data. Files that cannot be
+    // mapped are read by Poppler itself as before.
+    m_file = MappedFile::open(filePath);
+    if (m_file) {
+        m_device = m_file->device();
+        m_document = Poppler::Document::load(m_device.get());
+    } else {
+        m_document = Poppler::Document::load(filePath);
+    }
     
     if (!m_document) {
         qWarning() << "Failed to load PDF document:" << filePath;
@@ -41,107 +95,425 @@ bool PDFReader::load(const QString& filePath)
     m_document->setRenderHint(Poppler::Document::Antialiasing);
     m_document->setRenderHint(Poppler::Document::TextAntialiasing);
     
-    m_filePath = filePath;
+    m_pageCount = m_document->numPages();
+    m_renderHints = m_document->renderHints().toInt();
+    readInfo(filePath);
+    m_documentPool.open(filePath, m_file, m_document->renderHints());
+    m_queryPool.open(filePath, m_file, m_document->renderHints());
+    {
+        QMutexLocker measured(&m_measuredMutex);
+        m_measured.assign(m_pageCount, std::nullopt);
+    }
+    m_loaded = true;
+    
+    // Without background work, page sizes are measured as pages are asked
+    // for and searches extract text as they go
+    m_textIndex.reset(m_pageCount);
+    if (!m_backgroundWork) {
+        return true;
+    }
+    
+    // Measure all pages off the GUI thread, on a pooled document
+    m_geometryCancelled = false;
+    m_geometryThread.reset(QThread::create([this]() { buildPageGeometry(); }));
+    m_geometryThread->start(QThread::LowPriority);
+    
+    // Same for the text of every page, so searches stop re-extracting it
+    m_textIndexCancelled = false;
+    m_textIndexThread.reset(QThread::create([this]() { buildTextIndex(); }));
+    m_textIndexThread->start(QThread::LowestPriority);
     
     return true;
 }
 
+std::shared_ptr<const MappedFile> PDFReader::mappedFile() const
+{
+    QMutexLocker locker(&m_infoMutex);
+    return m_info.file;
+}
+
 void PDFReader::close()
 {
+    m_loaded = false;
+    stopPageGeometry();
+    stopTextIndex();
+    m_documentPool.close(); // Waits for renders on pooled documents
+    m_queryPool.close();
+    
+    QMutexLocker locker(&m_mutex);
+    
+    clearPageCache();
+    m_pageCacheStats = PageCacheStats();
+    
     m_document.reset();
-    m_filePath.clear();
+    m_device.reset();
+    m_file.reset();
+    m_pageCount = 0;
+    m_renderHints = 0;
+    
+    QMutexLocker info(&m_infoMutex);
+    m_info = Info();
 }
 
 bool PDFReader::isLoaded() const
 {
-    return m_document != nullptr;
+    return m_loaded;
 }
 
 int PDFReader::pageCount() const
 {
-    if (!m_document) {
-        return 0;
-    }
-    return m_document->numPages();
+    return m_pageCount;
 }
 
 QPixmap PDFReader::renderPage(int pageIndex, double dpi) const
 {
-    if (!m_document || pageIndex < 0 || pageIndex >= m_document->numPages()) {
+    QImage image = renderImage(pageIndex, dpi);
+    if (image.isNull()) {
         return QPixmap();
     }
     
-    std::unique_ptr<Poppler::Page> page(m_document->page(pageIndex));
-    if (!page) {
-        return QPixmap();
+    return QPixmap::fromImage(image);
+}
+
+QImage PDFReader::renderImage(int pageIndex, double dpi, const QRect& region,
+                              const std::atomic_bool* cancelled) const
+{
+    if (cancelled && cancelled->load()) {
+        return QImage();
+    }
+    
+    if (!isLoaded() || pageIndex < 0 || pageIndex >= m_pageCount) {
+        return QImage();
     }
     
-    QImage image = page->renderToImage(dpi, dpi);
+    QImage image;
+    withPage(pageIndex, [&](const Poppler::Page& page) {
+        image = renderPopplerPage(&page, dpi, region, cancelled);
+    });
+    
+    if (cancelled && cancelled->load()) {
+        return QImage();
+    }
     if (image.isNull()) {
         qWarning() << "Failed to render page" << pageIndex;
-        return QPixmap();
     }
     
-    return QPixmap::fromImage(image);
+    return image;
+}
+
+QImage PDFReader::renderThumbnail(int pageIndex, const QSize& box,
+                                  const std::atomic_bool* cancelled) const
+{
+    if ((cancelled && cancelled->load()) || box.isEmpty()) {
+        return QImage();
+    }
+    
+    if (!isLoaded() || pageIndex < 0 || pageIndex >= m_pageCount) {
+        return QImage();
+    }
+    
+    // The fitting DPI comes from the page being rendered rather than from
+    // pageSize(), so no other document is consulted before the render
+    QImage image;
+    withPage(pageIndex, [&](const Poppler::Page& page) {
+        QSizeF size = page.pageSizeF();
+        if (size.isEmpty()) {
+            return;
+        }
+        // Just below the exact fit, as in DocumentReader::renderThumbnail()
+        double scale = std::min(box.width() / size.width(), box.height() / size.height());
+        image = renderPopplerPage(&page, 72.0 * scale * (1.0 - 1e-6), QRect(), cancelled);
+    });
+    
+    if (cancelled && cancelled->load()) {
+        return QImage();
+    }
+    return image;
 }
 
 QSizeF PDFReader::pageSize(int pageIndex) const
 {
-    if (!m_document || pageIndex < 0 || pageIndex >= m_document->numPages()) {
+    if (m_geometryReady.load(std::memory_order_acquire)) {
+        if (pageIndex < 0 || pageIndex >= m_pageGeometry.size()) {
+            return QSizeF();
+        }
+        return m_pageGeometry[pageIndex].size;
+    }
+    
+    if (!isLoaded() || pageIndex < 0 || pageIndex >= m_pageCount) {
         return QSizeF();
     }
     
+    // Table not built yet, or not built at all without background work
+    return measure(pageIndex).size;
+}
+
+bool PDFReader::pageGeometryReady() const
+{
+    return m_geometryReady.load(std::memory_order_acquire);
+}
+
+Poppler::Page::Orientation PDFReader::pageOrientation(int pageIndex) const
+{
+    if (m_geometryReady.load(std::memory_order_acquire)) {
+        if (pageIndex < 0 || pageIndex >= m_pageGeometry.size()) {
+            return Poppler::Page::Portrait;
+        }
+        return m_pageGeometry[pageIndex].orientation;
+    }
+    
+    if (!isLoaded() || pageIndex < 0 || pageIndex >= m_pageCount) {
+        return Poppler::Page::Portrait;
+    }
+    
+    return measure(pageIndex).orientation;
+}
+
+PDFReader::PageGeometry PDFReader::measure(int pageIndex) const
+{
+    {
+        QMutexLocker locker(&m_measuredMutex);
+        if (pageIndex < static_cast<int>(m_measured.size()) && m_measured[pageIndex]) {
+            return *m_measured[pageIndex];
+        }
+    }
+    
+    PopplerDocumentPool::Lease document = m_queryPool.acquire();
+    std::unique_ptr<Poppler::Page> page(document ? document->page(pageIndex) : nullptr);
+    if (!page) {
+        return {QSizeF(), Poppler::Page::Portrait};
+    }
+    remember(pageIndex, *page);
+    return {page->pageSizeF(), page->orientation()};
+}
+
+void PDFReader::remember(int pageIndex, const Poppler::Page& page) const
+{
+    if (m_geometryReady.load(std::memory_order_acquire)) {
+        return;
+    }
+    
+    QMutexLocker locker(&m_measuredMutex);
+    if (pageIndex < static_cast<int>(m_measured.size()) && !m_measured[pageIndex]) {
+        m_measured[pageIndex] = PageGeometry{page.pageSizeF(), page.orientation()};
+    }
+}
+
+void PDFReader::buildPageGeometry()
+{
+    QList<PageGeometry> geometry;
+    geometry.reserve(m_pageCount);
+    
+    // Walks every page once on a pooled document, so it neither flushes
+    // the page cache nor holds up renders on the main document
+    PopplerDocumentPool::Lease document = m_documentPool.acquire();
+    if (!document) {
+        return; // Sizes keep coming from measure()
+    }
+    
+    for (int i = 0; i < m_pageCount; ++i) {
+        if (m_geometryCancelled.load()) {
+            return;
+        }
+        
+        std::unique_ptr<Poppler::Page> page(document->page(i));
+        if (page) {
+            geometry.append({page->pageSizeF(), page->orientation()});
+        } else {
+            geometry.append({QSizeF(), Poppler::Page::Portrait});
+        }
+    }
+    
+    m_pageGeometry = std::move(geometry);
+    m_geometryReady.store(true, std::memory_order_release);
+    notifyPageGeometryReady();
+}
+
+void PDFReader::buildTextIndex()
+{
+    // One worker per pooled document, each taking the next unclaimed page;
+    // like the geometry scan this bypasses the page cache
+    std::atomic_int nextPage(0);
+    auto extract = [this, &nextPage]() {
+        PopplerDocumentPool::Lease document = m_documentPool.acquire();
+        if (!document) {
+            return;
+        }
+        for (int i = nextPage++; i < m_pageCount && !m_textIndexCancelled.load(); i = nextPage++) {
+            std::unique_ptr<Poppler::Page> page(document->page(i));
+            m_textIndex.addPage(i, page ? page->text(QRectF()) : QString());
+        }
+    };
+    
+    // The geometry scan started alongside holds a pooled document of its
+    // own, and one more stays free for renders that find the main one busy
+    int workers = std::min(std::max(1, m_documentPool.maxHandles() - 2), m_pageCount);
+    std::vector<std::unique_ptr<QThread>> threads;
+    for (int i = 1; i < workers; ++i) {
+        threads.emplace_back(QThread::create(extract));
+        threads.back()->start(QThread::LowestPriority);
+    }
+    extract();
+    for (auto& thread : threads) {
+        thread->wait();
+    }
+    
+    // The main document is left to the renders, even if no pooled one could
+    // be opened: an unfinished index only means searches extract the
+    // missing pages themselves
+}
+
+void PDFReader::stopTextIndex()
+{
+    if (m_textIndexThread) {
+        m_textIndexCancelled = true;
+        m_textIndexThread->wait();
+        m_textIndexThread.reset();
+    }
+    
+    m_textIndex.reset(0);
+}
+
+const TextIndex& PDFReader::textIndex() const
+{
+    return m_textIndex;
+}
+
+void PDFReader::stopPageGeometry()
+{
+    if (m_geometryThread) {
+        m_geometryCancelled = true;
+        m_geometryThread->wait();
+        m_geometryThread.reset();
+    }
+    
+    m_geometryReady = false;
+    m_pageGeometry.clear();
+    
+    QMutexLocker locker(&m_measuredMutex);
+    m_measured.clear();
+}
+
+Poppler::Page* PDFReader::getPage(int pageIndex) const
+{
+    for (auto it = m_pageCache.begin(); it != m_pageCache.end(); ++it) {
+        if (it->index == pageIndex) {
+            m_pageCache.splice(m_pageCache.begin(), m_pageCache, it);
+            ++m_pageCacheStats.hits;
+            return m_pageCache.front().page.get();
+        }
+    }
+    
+    QElapsedTimer timer;
+    timer.start();
     std::unique_ptr<Poppler::Page> page(m_document->page(pageIndex));
+    m_pageCacheStats.parseNanoseconds += timer.nsecsElapsed();
+    ++m_pageCacheStats.misses;
+    
     if (!page) {
-        return QSizeF();
+        return nullptr;
     }
     
-    return page->pageSizeF();
+    m_pageCache.push_front({pageIndex, std::move(page)});
+    if (static_cast<int>(m_pageCache.size()) > PAGE_CACHE_SIZE) {
+        m_pageCache.pop_back();
+    }
+    return m_pageCache.front().page.get();
 }
 
-QString PDFReader::title() const
+bool PDFReader::withPage(int pageIndex, const std::function<void(const Poppler::Page&)>& work) const
 {
+    std::unique_lock<QMutex> lock(m_mutex, std::try_to_lock);
+    PopplerDocumentPool::Lease pooled;
+    if (!lock.owns_lock()) {
+        pooled = m_documentPool.tryAcquire();
+        if (!pooled) {
+            lock.lock(); // Every pooled document is busy too
+        }
+    }
+    
+    if (pooled) {
+        std::unique_ptr<Poppler::Page> page(pooled->page(pageIndex));
+        if (!page) {
+            return false;
+        }
+        remember(pageIndex, *page);
+        work(*page);
+        return true;
+    }
+    
     if (!m_document) {
-        return QString();
+        return false;
     }
-    return m_document->info("Title");
+    Poppler::Page* page = getPage(pageIndex);
+    if (!page) {
+        return false;
+    }
+    remember(pageIndex, *page);
+    work(*page);
+    return true;
+}
+
+void PDFReader::clearPageCache()
+{
+    m_pageCache.clear();
+}
+
+double PDFReader::PageCacheStats::averageParseMs() const
+{
+    return misses > 0 ? parseNanoseconds / 1e6 / misses : 0.0;
+}
+
+double PDFReader::PageCacheStats::savedMs() const
+{
+    return hits * averageParseMs();
+}
+
+PDFReader::PageCacheStats PDFReader::pageCacheStats() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_pageCacheStats;
+}
+
+int PDFReader::renderHints() const
+{
+    return m_renderHints;
+}
+
+QString PDFReader::title() const
+{
+    QMutexLocker locker(&m_infoMutex);
+    return m_info.title;
 }
 
 QString PDFReader::author() const
 {
-    if (!m_document) {
-        return QString();
-    }
-    return m_document->info("Author");
+    QMutexLocker locker(&m_infoMutex);
+    return m_info.author;
 }
 
 QString PDFReader::subject() const
 {
-    if (!m_document) {
-        return QString();
-    }
-    return m_document->info("Subject");
+    QMutexLocker locker(&m_infoMutex);
+    return m_info.subject;
 }
 
 QString PDFReader::creator() const
 {
-    if (!m_document) {
-        return QString();
-    }
-    return m_document->info("Creator");
+    QMutexLocker locker(&m_infoMutex);
+    return m_info.creator;
 }
 
 QString PDFReader::producer() const
 {
-    if (!m_document) {
-        return QString();
-    }
-    return m_document->info("Producer");
+    QMutexLocker locker(&m_infoMutex);
+    return m_info.producer;
 }
 
 QString PDFReader::filePath() const
 {
-    return m_filePath;
+    QMutexLocker locker(&m_infoMutex);
+    return m_info.filePath;
 }
 
 bool PDFReader::supportsTextExtraction() const
@@ -151,37 +523,70 @@ bool PDFReader::supportsTextExtraction() const
 
 QString PDFReader::extractText(int pageIndex) const
 {
-    if (!m_document || pageIndex < 0 || pageIndex >= m_document->numPages()) {
-        return QString();
+    if (m_textIndex.hasPage(pageIndex)) {
+        return m_textIndex.pageText(pageIndex);
     }
     
-    std::unique_ptr<Poppler::Page> page(m_document->page(pageIndex));
-    if (!page) {
+    if (!isLoaded() || pageIndex < 0 || pageIndex >= m_pageCount) {
         return QString();
     }
     
-    return page->text(QRectF());
+    // Through the pool when the main document is busy, so pages not yet
+    // indexed can be extracted from several threads at once
+    QString text;
+    withPage(pageIndex, [&](const Poppler::Page& page) {
+        text = page.text(QRectF());
+    });
+    return text;
+}
+
+QList<PDFReader::Word> PDFReader::extractWords(int pageIndex) const
+{
+    if (!isLoaded() || pageIndex < 0 || pageIndex >= m_pageCount) {
+        return QList<Word>();
+    }
+    
+    QList<Word> words;
+    withPage(pageIndex, [&](const Poppler::Page& page) {
+        std::vector<std::unique_ptr<Poppler::TextBox>> boxes = page.textList();
+        words.reserve(static_cast<qsizetype>(boxes.size()));
+        for (const std::unique_ptr<Poppler::TextBox>& box : boxes) {
+            words.append({box->text(), box->boundingBox(), box->hasSpaceAfter()});
+        }
+    });
+    return words;
 }
 
 QList<int> PDFReader::searchText(const QString& searchText, bool caseSensitive) const
 {
     QList<int> results;
     
-    if (!m_document || searchText.isEmpty()) {
+    if (!isLoaded() || searchText.isEmpty()) {
         return results;
     }
     
-    for (int i = 0; i < m_document->numPages(); ++i) {
-        QString pageText = extractText(i);
-        if (!pageText.isEmpty()) {
-            if (caseSensitive) {
-                if (pageText.contains(searchText, Qt::CaseSensitive)) {
-                    results.append(i);
-                }
-            } else {
-                if (pageText.contains(searchText, Qt::CaseInsensitive)) {
-                    results.append(i);
-                }
+    if (m_textIndex.isComplete()) {
+        return m_textIndex.search(searchText, caseSensitive);
+    }
+    
+    // While the index is still being built, indexed pages are searched in
+    // their cached text and the rest are extracted, taking the lock per
+    // page so renders can interleave. Case-insensitive search compares
+    // folded text exactly, so the query is folded once rather than every
+    // character on every comparison.
+    QString foldedSearchText = searchText.toCaseFolded();
+    for (int i = 0; i < m_pageCount; ++i) {
+        if (caseSensitive) {
+            if (TextSearch::contains(extractText(i), searchText)) {
+                results.append(i);
+            }
+        } else {
+            QString foldedText = m_textIndex.foldedPageText(i);
+            if (foldedText.isNull()) {
+                foldedText = extractText(i).toCaseFolded();
+            }
+            if (TextSearch::contains(foldedText, foldedSearchText)) {
+                results.append(i);
             }
         }
     }
@@ -189,36 +594,100 @@ QList<int> PDFReader::searchText(const QString& searchText, bool caseSensitive)
     return results;
 }
 
-bool PDFReader::isEncrypted() const
+QList<QList<int>> PDFReader::searchTerms(const QStringList& terms, bool caseSensitive) const
 {
-    if (!m_document) {
-        return false;
+    if (caseSensitive || !isLoaded()) {
+        return DocumentReader::searchTerms(terms, caseSensitive);
     }
-    return m_document->isEncrypted();
+    
+    QStringList patterns;
+    for (const QString& term : terms) {
+        patterns.append(term.toCaseFolded());
+    }
+    MultiPatternMatcher matcher(patterns);
+    
+    // Indexed pages were folded when they were cached
+    QList<QList<int>> results(terms.size());
+    for (int i = 0; i < m_pageCount; ++i) {
+        QString foldedText = m_textIndex.foldedPageText(i);
+        if (foldedText.isNull()) {
+            foldedText = extractText(i).toCaseFolded();
+        }
+        for (int term : matcher.findIn(foldedText)) {
+            results[term].append(i);
+        }
+    }
+    return results;
+}
+
+QList<QRectF> PDFReader::searchPage(int pageIndex, const QString& searchText, bool caseSensitive) const
+{
+    if (!isLoaded() || searchText.isEmpty() || pageIndex < 0 || pageIndex >= m_pageCount) {
+        return QList<QRectF>();
+    }
+    
+    // Most pages of a long document don't match; the index rules those
+    // out without asking Poppler
+    if (!m_textIndex.mayContain(pageIndex, searchText)) {
+        return QList<QRectF>();
+    }
+    
+    Poppler::Page::SearchFlags flags = caseSensitive ? Poppler::Page::NoSearchFlags : Poppler::Page::IgnoreCase;
+    QList<QRectF> hits;
+    withPage(pageIndex, [&](const Poppler::Page& page) {
+        hits = page.search(searchText, flags);
+    });
+    return hits;
+}
+
+bool PDFReader::isEncrypted() const
+{
+    QMutexLocker locker(&m_infoMutex);
+    return m_info.encrypted;
 }
 
 bool PDFReader::unlock(const QString& password)
 {
+    QMutexLocker locker(&m_mutex);
     if (!m_document) {
         return false;
     }
-    return m_document->unlock(password.toUtf8(), password.toUtf8());
+    clearPageCache(); // Pages parsed while locked are not valid afterwards
+    m_documentPool.setPassword(password.toUtf8());
+    m_queryPool.setPassword(password.toUtf8());
+    bool locked = m_document->unlock(password.toUtf8(), password.toUtf8());
+    readInfo(filePath()); // Only readable once unlocked
+    return locked;
+}
+
+void PDFReader::readInfo(const QString& filePath)
+{
+    Info info;
+    info.filePath = filePath;
+    info.file = m_file;
+    info.title = m_document->info("Title");
+    info.author = m_document->info("Author");
+    info.subject = m_document->info("Subject");
+    info.creator = m_document->info("Creator");
+    info.producer = m_document->info("Producer");
+    info.creationDate = m_document->date("CreationDate");
+    info.modificationDate = m_document->date("ModDate");
+    info.encrypted = m_document->isEncrypted();
+    
+    QMutexLocker locker(&m_infoMutex);
+    m_info = std::move(info);
 }
 
 QDateTime PDFReader::creationDate() const
 {
-    if (!m_document) {
-        return QDateTime();
-    }
-    return m_document->date("CreationDate");
+    QMutexLocker locker(&m_infoMutex);
+    return m_info.creationDate;
 }
 
 QDateTime PDFReader::modificationDate() const
 {
-    if (!m_document) {
-        return QDateTime();
-    }
-    return m_document->date("ModDate");
+    QMutexLocker locker(&m_infoMutex);
+    return m_info.modificationDate;
 }
 
 QString PDFReader::version() const
@@ -1,8 +1,19 @@
 #pragma once
 
 #include "documentreader.h"
+#include "popplerdocumentpool.h"
+#include "textindex.h"
 #include <memory>
+#include <list>
+#include <functional>
+#include <optional>
+#include <vector>
+#include <QBuffer>
 #include <QDateTime>
+#include <QMutex>
+#include <QThread>
+#include <QList>
+#include <QElapsedTimer>
 #include <poppler-qt6.h>
 
 /**
@@ -21,7 +32,14 @@ public:
     bool isLoaded() const override;
     int pageCount() const override;
     QPixmap renderPage(int pageIndex, double dpi = 72.0) const override;
+    QImage renderImage(int pageIndex, double dpi = 72.0, const QRect& region = QRect(),
+                       const std::atomic_bool* cancelled = nullptr) const override;
+    QImage renderThumbnail(int pageIndex, const QSize& box,
+                           const std::atomic_bool* cancelled = nullptr) const override;
     QSizeF pageSize(int pageIndex) const override;
+    bool pageGeometryReady() const override;
+    int renderHints() const override;
+    std::shared_ptr<const MappedFile> mappedFile() const override;
     
     QString title() const override;
     QString author() const override;
@@ -32,7 +50,10 @@ public:
     
     bool supportsTextExtraction() const override;
     QString extractText(int pageIndex) const override;
+    QList<Word> extractWords(int pageIndex) const override;
     QList<int> searchText(const QString& searchText, bool caseSensitive = false) const override;
+    QList<QList<int>> searchTerms(const QStringList& terms, bool caseSensitive = false) const override;
+    QList<QRectF> searchPage(int pageIndex, const QString& searchText, bool caseSensitive = false) const override;
     
     // PDF-specific methods
     bool isEncrypted() const;
@@ -41,11 +62,122 @@ public:
     QDateTime modificationDate() const;
     QString version() const;
     
+    /**
+     * Get the orientation a page is displayed in by default.
+     * @param pageIndex 0-based page index
+     * @return Page orientation, or Portrait if page doesn't exist
+     */
+    Poppler::Page::Orientation pageOrientation(int pageIndex) const;
+    
+    /**
+     * Get the full-text index, which fills up in the background after load().
+     */
+    const TextIndex& textIndex() const;
+    
+    /**
+     * Statistics of the pool of parsed pages. Every hit is a page that did
+     * not have to be parsed again, which saves averageParseMs() per call.
+     */
+    struct PageCacheStats
+    {
+        quint64 hits = 0;
+        quint64 misses = 0;
+        qint64 parseNanoseconds = 0; // Time spent creating pages on misses
+        
+        double averageParseMs() const;
+        double savedMs() const;
+    };
+    
+    PageCacheStats pageCacheStats() const;
+    
 private:
+    // The document reads the file through m_device, a view of m_file;
+    // both must outlive it
+    std::shared_ptr<const MappedFile> m_file;
+    std::unique_ptr<QBuffer> m_device;
     std::unique_ptr<Poppler::Document> m_document;
-    QString m_filePath;
+    std::atomic_bool m_loaded;
+    
+    // Poppler::Document is not safe for concurrent use; every access to
+    // m_document after load() goes through this lock. Values the GUI needs
+    // often are cached at load time so it never waits behind a render.
+    mutable QMutex m_mutex;
+    int m_pageCount;
+    int m_renderHints;
+    
+    // Document information, read once by load(). Guarded by its own lock,
+    // which is never held for longer than a copy.
+    struct Info {
+        QString filePath;
+        std::shared_ptr<const MappedFile> file;
+        QString title;
+        QString author;
+        QString subject;
+        QString creator;
+        QString producer;
+        QDateTime creationDate;
+        QDateTime modificationDate;
+        bool encrypted = false;
+    };
+    void readInfo(const QString& filePath); // Needs m_mutex
+    mutable QMutex m_infoMutex;
+    Info m_info;
+    
+    // Independent documents on the same file for work that runs on several
+    // threads at once: renders that find m_document busy, the geometry
+    // scan and the text index
+    mutable PopplerDocumentPool m_documentPool;
     
-    // No page caching for now - will load pages on demand
+    // A document of its own for page sizes and orientations asked for
+    // before the geometry table is complete, so those quick queries never
+    // wait behind a render or an extraction
+    mutable PopplerDocumentPool m_queryPool;
+    
+    // Size and orientation of every page, measured once on a background
+    // thread after load() and immutable afterwards. Read without locking
+    // once m_geometryReady is set.
+    struct PageGeometry {
+        QSizeF size;
+        Poppler::Page::Orientation orientation;
+    };
+    void buildPageGeometry();
+    void stopPageGeometry();
+    QList<PageGeometry> m_pageGeometry;
+    std::atomic_bool m_geometryReady;
+    
+    // Geometry of the pages measured so far, filled by every page that is
+    // parsed for any reason until the table above is ready
+    PageGeometry measure(int pageIndex) const;
+    void remember(int pageIndex, const Poppler::Page& page) const;
+    mutable QMutex m_measuredMutex;
+    mutable std::vector<std::optional<PageGeometry>> m_measured;
+    std::atomic_bool m_geometryCancelled;
+    std::unique_ptr<QThread> m_geometryThread;
+    
+    // Text of every page, extracted once on a background thread after
+    // load(); extractText() and searchText() use it for indexed pages
+    void buildTextIndex();
+    void stopTextIndex();
+    TextIndex m_textIndex;
+    std::atomic_bool m_textIndexCancelled;
+    std::unique_ptr<QThread> m_textIndexThread;
+    
+    // Recently used pages, most recent first. Rendering, measuring and
+    // extracting text from one page parse it only once. Guarded by m_mutex;
+    // a page returned by getPage() is only valid while the lock is held.
+    struct CachedPage {
+        int index;
+        std::unique_ptr<Poppler::Page> page;
+    };
     Poppler::Page* getPage(int pageIndex) const;
     void clearPageCache();
+    
+    // Calls work with a page taken from m_document (through the page
+    // cache) if it is free, otherwise from a pooled document, so worker
+    // threads don't queue up behind each other
+    bool withPage(int pageIndex, const std::function<void(const Poppler::Page&)>& work) const;
+    mutable std::list<CachedPage> m_pageCache;
+    mutable PageCacheStats m_pageCacheStats;
+    
+    static constexpr int PAGE_CACHE_SIZE = 16;
 };
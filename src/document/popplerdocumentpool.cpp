@@ -0,0 +1,211 @@
+#include "popplerdocumentpool.h"
+#include "mappedfile.h"
+#include <QDebug>
+#include <QMutexLocker>
+#include <QThread>
+#include <algorithm>
+
+PopplerDocumentPool::Lease::Lease(PopplerDocumentPool* pool, Handle handle, quint64 generation)
+    : m_pool(pool)
+    , m_handle(std::move(handle))
+    , m_generation(generation)
+{
+}
+
+PopplerDocumentPool::Lease::Lease(Lease&& other) noexcept
+    : m_pool(other.m_pool)
+    , m_handle(std::move(other.m_handle))
+    , m_generation(other.m_generation)
+{
+    other.m_pool = nullptr;
+}
+
+PopplerDocumentPool::Lease& PopplerDocumentPool::Lease::operator=(Lease&& other) noexcept
+{
+    if (this != &other) {
+        release();
+        m_pool = other.m_pool;
+        m_handle = std::move(other.m_handle);
+        m_generation = other.m_generation;
+        other.m_pool = nullptr;
+    }
+    return *this;
+}
+
+PopplerDocumentPool::Lease::~Lease()
+{
+    release();
+}
+
+void PopplerDocumentPool::Lease::release()
+{
+    if (m_pool) {
+        m_pool->release(std::move(m_handle), m_generation);
+        m_pool = nullptr;
+    }
+}
+
+PopplerDocumentPool::PopplerDocumentPool(int maxHandles)
+    : m_opened(0)
+    , m_leased(0)
+    , m_maxHandles(maxHandles)
+    , m_generation(0)
+{
+}
+
+PopplerDocumentPool::~PopplerDocumentPool()
+{
+    close();
+}
+
+void PopplerDocumentPool::open(const QString& filePath, std::shared_ptr<const MappedFile> file,
+                               Poppler::Document::RenderHints renderHints)
+{
+    close();
+
+    QMutexLocker locker(&m_mutex);
+    m_filePath = filePath;
+    m_file = std::move(file);
+    m_renderHints = renderHints;
+}
+
+void PopplerDocumentPool::close()
+{
+    QMutexLocker locker(&m_mutex);
+    m_filePath.clear();
+    m_password.clear();
+    invalidateHandles();
+    m_returned.wakeAll(); // Waiting acquire() calls give up
+
+    while (m_leased > 0) {
+        m_returned.wait(&m_mutex);
+    }
+    m_file.reset();
+}
+
+void PopplerDocumentPool::setPassword(const QByteArray& password)
+{
+    QMutexLocker locker(&m_mutex);
+    m_password = password;
+
+    // Handles opened without the password are of no use
+    invalidateHandles();
+    m_returned.wakeAll();
+}
+
+void PopplerDocumentPool::setMaxHandles(int maxHandles)
+{
+    QMutexLocker locker(&m_mutex);
+    m_maxHandles = maxHandles;
+}
+
+int PopplerDocumentPool::maxHandles() const
+{
+    QMutexLocker locker(&m_mutex);
+    return limit();
+}
+
+PopplerDocumentPool::Lease PopplerDocumentPool::acquire()
+{
+    return take(true);
+}
+
+PopplerDocumentPool::Lease PopplerDocumentPool::tryAcquire()
+{
+    return take(false);
+}
+
+PopplerDocumentPool::Lease PopplerDocumentPool::take(bool wait)
+{
+    QMutexLocker locker(&m_mutex);
+
+    while (!m_filePath.isEmpty() && m_idle.empty() && m_opened >= limit()) {
+        if (!wait) {
+            return Lease();
+        }
+        m_returned.wait(&m_mutex);
+    }
+
+    if (m_filePath.isEmpty()) {
+        return Lease();
+    }
+
+    ++m_leased;
+    if (!m_idle.empty()) {
+        Handle handle = std::move(m_idle.back());
+        m_idle.pop_back();
+        return Lease(this, std::move(handle), m_generation);
+    }
+
+    // Opening parses the file's cross-reference table, which can take a
+    // while; don't hold up the other threads meanwhile
+    ++m_opened;
+    quint64 generation = m_generation;
+    QString filePath = m_filePath;
+    std::shared_ptr<const MappedFile> file = m_file;
+    QByteArray password = m_password;
+    Poppler::Document::RenderHints renderHints = m_renderHints;
+    locker.unlock();
+
+    Handle handle = createHandle(filePath, file, password, renderHints);
+    if (!handle.document) {
+        locker.relock();
+        if (generation == m_generation) {
+            --m_opened;
+        }
+        --m_leased;
+        m_returned.wakeAll();
+        return Lease();
+    }
+    return Lease(this, std::move(handle), generation);
+}
+
+int PopplerDocumentPool::limit() const
+{
+    return m_maxHandles > 0 ? m_maxHandles : std::max(1, QThread::idealThreadCount());
+}
+
+void PopplerDocumentPool::invalidateHandles()
+{
+    // Leased handles of the old generation are destroyed when returned and
+    // no longer count against the limit
+    ++m_generation;
+    m_idle.clear();
+    m_opened = 0;
+}
+
+PopplerDocumentPool::Handle PopplerDocumentPool::createHandle(
+    const QString& filePath, const std::shared_ptr<const MappedFile>& file,
+    const QByteArray& password, Poppler::Document::RenderHints renderHints)
+{
+    Handle handle;
+    if (file) {
+        handle.file = file;
+        handle.device = file->device();
+        handle.document = Poppler::Document::load(handle.device.get(), password, password);
+    } else {
+        handle.document = Poppler::Document::load(filePath, password, password);
+    }
+    if (!handle.document || handle.document->isLocked()) {
+        qWarning() << "Failed to open pooled PDF document:" << filePath;
+        return Handle();
+    }
+
+    Poppler::Document* document = handle.document.get();
+    for (auto hint : {Poppler::Document::Antialiasing, Poppler::Document::TextAntialiasing,
+                      Poppler::Document::TextHinting, Poppler::Document::TextSlightHinting,
+                      Poppler::Document::ThinLineSolid, Poppler::Document::ThinLineShape}) {
+        document->setRenderHint(hint, renderHints.testFlag(hint));
+    }
+    return handle;
+}
+
+void PopplerDocumentPool::release(Handle handle, quint64 generation)
+{
+    QMutexLocker locker(&m_mutex);
+    --m_leased;
+    if (handle.document && generation == m_generation) {
+        m_idle.push_back(std::move(handle));
+    }
+    m_returned.wakeAll();
+}
@@ -0,0 +1,127 @@
+#pragma once
+
+#include <QBuffer>
+#include <QByteArray>
+#include <QMutex>
+#include <QtGlobal>
+#include <QString>
+#include <QWaitCondition>
+#include <memory>
+#include <vector>
+#include <poppler-qt6.h>
+
+class MappedFile;
+
+/**
+ * Pool of independent Poppler documents opened on the same file.
+ *
+ * A Poppler::Document must not be used by two threads at once, so work that
+ * should run on several cores leases a handle of its own from the pool and
+ * returns it when done. Handles are opened lazily, up to one per core by
+ * default, and kept open between leases. When the file is mapped, every
+ * handle reads the one shared mapping rather than opening the file again.
+ *
+ * Thread-safe.
+ */
+class PopplerDocumentPool
+{
+public:
+    /**
+     * Exclusive use of one pooled document; returned to the pool when
+     * destroyed. An empty lease (no handle available, or the file could not
+     * be opened) converts to false.
+     */
+    class Lease
+    {
+    public:
+        Lease() = default;
+        Lease(Lease&& other) noexcept;
+        Lease& operator=(Lease&& other) noexcept;
+        ~Lease();
+
+        Poppler::Document* get() const { return m_handle.document.get(); }
+        Poppler::Document* operator->() const { return m_handle.document.get(); }
+        explicit operator bool() const { return m_handle.document != nullptr; }
+
+    private:
+        friend class PopplerDocumentPool;
+
+        // A document and, when it reads from a mapping, the device it reads
+        // through; destroyed document first
+        struct Handle {
+            std::shared_ptr<const MappedFile> file;
+            std::unique_ptr<QBuffer> device;
+            std::unique_ptr<Poppler::Document> document;
+        };
+
+        Lease(PopplerDocumentPool* pool, Handle handle, quint64 generation);
+        void release();
+
+        PopplerDocumentPool* m_pool = nullptr;
+        Handle m_handle;
+        quint64 m_generation = 0;
+    };
+
+    explicit PopplerDocumentPool(int maxHandles = 0);
+    ~PopplerDocumentPool();
+
+    PopplerDocumentPool(const PopplerDocumentPool&) = delete;
+    PopplerDocumentPool& operator=(const PopplerDocumentPool&) = delete;
+
+    /**
+     * Start handing out documents for a file. Opens nothing yet.
+     * @param filePath PDF file every handle is opened on
+     * @param file Mapping of the file to read instead, or nullptr
+     * @param renderHints Render hints applied to every handle
+     */
+    void open(const QString& filePath, std::shared_ptr<const MappedFile> file,
+              Poppler::Document::RenderHints renderHints);
+
+    /**
+     * Wait until every lease has been returned, then close all handles.
+     */
+    void close();
+
+    /**
+     * Set the password used to unlock handles; idle handles are reopened.
+     */
+    void setPassword(const QByteArray& password);
+
+    /**
+     * Maximum number of handles, 0 meaning one per core.
+     */
+    void setMaxHandles(int maxHandles);
+    int maxHandles() const;
+
+    /**
+     * Lease a handle, waiting while all of them are in use.
+     */
+    Lease acquire();
+
+    /**
+     * Lease a handle if one is idle or may still be opened; never waits
+     * for another lease to be returned.
+     */
+    Lease tryAcquire();
+
+private:
+    Lease take(bool wait);
+    int limit() const;
+    void invalidateHandles();
+    using Handle = Lease::Handle;
+    void release(Handle handle, quint64 generation);
+    static Handle createHandle(const QString& filePath, const std::shared_ptr<const MappedFile>& file,
+                               const QByteArray& password, Poppler::Document::RenderHints renderHints);
+
+    mutable QMutex m_mutex;
+    QWaitCondition m_returned;
+    QString m_filePath;
+    std::shared_ptr<const MappedFile> m_file;
+    QByteArray m_password;
+    Poppler::Document::RenderHints m_renderHints;
+    std::vector<Handle> m_idle;
+    int m_opened;          // Handles of the current generation, idle or leased
+    int m_leased;          // Leases out, of any generation
+    int m_maxHandles;
+    quint64 m_generation;  // Bumped whenever existing handles become unusable
+};
@@ -0,0 +1,174 @@
+#include "rendercache.h"
+#include <QHashFunctions>
+#include <algorithm>
+#include <cmath>
+
+RenderKey::RenderKey(const DocumentReader* doc, int page, double dpi, int renderHints,
+                     const QRect& tileRect)
+    : document(doc)
+    , pageIndex(page)
+    , dpiCenti(static_cast<int>(std::lround(dpi * 100.0)))
+    , hints(renderHints)
+    , tile(tileRect)
+{
+}
+
+size_t qHash(const RenderKey& key, size_t seed)
+{
+    return qHashMulti(seed, key.document, key.pageIndex, key.dpiCenti, key.hints,
+                      key.tile.x(), key.tile.y(), key.tile.width(), key.tile.height());
+}
+
+double RenderCache::Stats::hitRate() const
+{
+    const quint64 lookups = hits + misses;
+    return lookups > 0 ? static_cast<double>(hits) / lookups : 0.0;
+}
+
+RenderCache::RenderCache(qint64 budgetBytes)
+    : m_budget(budgetBytes)
+    , m_bytes(0)
+    , m_hits(0)
+    , m_misses(0)
+    , m_evictions(0)
+{
+}
+
+QPixmap RenderCache::find(const RenderKey& key)
+{
+    auto it = m_index.find(key);
+    if (it == m_index.end()) {
+        ++m_misses;
+        return QPixmap();
+    }
+
+    ++m_hits;
+    m_entries.splice(m_entries.begin(), m_entries, it.value());
+    return it.value()->pixmap;
+}
+
+QPixmap RenderCache::peek(const RenderKey& key) const
+{
+    auto it = m_index.constFind(key);
+    return it != m_index.constEnd() ? it.value()->pixmap : QPixmap();
+}
+
+QPixmap RenderCache::closest(const RenderKey& key) const
+{
+    // Compare resolutions on a log scale so 2x up and 2x down score the same,
+    // then prefer the sharper one on ties
+    const Entry* best = nullptr;
+    double bestScore = 0.0;
+    for (const Entry& entry : m_entries) {
+        const RenderKey& candidate = entry.key;
+        if (candidate.document != key.document || candidate.pageIndex != key.pageIndex ||
+            candidate.hints != key.hints || candidate.isTile() || candidate.dpiCenti <= 0) {
+            continue;
+        }
+        double score = std::abs(std::log(static_cast<double>(candidate.dpiCenti) / key.dpiCenti));
+        if (candidate.dpiCenti < key.dpiCenti) {
+            score += 0.01;
+        }
+        if (!best || score < bestScore) {
+            best = &entry;
+            bestScore = score;
+        }
+    }
+    return best ? best->pixmap : QPixmap();
+}
+
+bool RenderCache::contains(const RenderKey& key) const
+{
+    return m_index.contains(key);
+}
+
+void RenderCache::insert(const RenderKey& key, const QPixmap& pixmap)
+{
+    if (!key.isValid() || pixmap.isNull()) {
+        return;
+    }
+
+    auto existing = m_index.find(key);
+    if (existing != m_index.end()) {
+        m_bytes -= existing.value()->cost;
+        m_entries.erase(existing.value());
+        m_index.erase(existing);
+    }
+
+    const qint64 cost = costOf(pixmap);
+    if (cost > m_budget) {
+        return;
+    }
+
+    evictToBudget(m_budget - cost);
+
+    m_entries.push_front(Entry{key, pixmap, cost});
+    m_index.insert(key, m_entries.begin());
+    m_bytes += cost;
+}
+
+void RenderCache::removeDocument(const DocumentReader* document)
+{
+    for (auto it = m_entries.begin(); it != m_entries.end();) {
+        if (it->key.document == document) {
+            m_bytes -= it->cost;
+            m_index.remove(it->key);
+            it = m_entries.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+void RenderCache::clear()
+{
+    m_entries.clear();
+    m_index.clear();
+    m_bytes = 0;
+}
+
+void RenderCache::setBudget(qint64 bytes)
+{
+    m_budget = std::max<qint64>(0, bytes);
+    evictToBudget(m_budget);
+}
+
+qint64 RenderCache::budget() const
+{
+    return m_budget;
+}
+
+RenderCache::Stats RenderCache::stats() const
+{
+    Stats stats;
+    stats.hits = m_hits;
+    stats.misses = m_misses;
+    stats.evictions = m_evictions;
+    stats.bytes = m_bytes;
+    stats.budget = m_budget;
+    stats.entries = static_cast<int>(m_index.size());
+    return stats;
+}
+
+void RenderCache::resetStats()
+{
+    m_hits = 0;
+    m_misses = 0;
+    m_evictions = 0;
+}
+
+qint64 RenderCache::costOf(const QPixmap& pixmap)
+{
+    return static_cast<qint64>(pixmap.width()) * pixmap.height() * pixmap.depth() / 8;
+}
+
+void RenderCache::evictToBudget(qint64 budget)
+{
+    while (m_bytes > budget && !m_entries.empty()) {
+        const Entry& victim = m_entries.back();
+        m_bytes -= victim.cost;
+        m_index.remove(victim.key);
+        m_entries.pop_back();
+        ++m_evictions;
+    }
+}
@@ -0,0 +1,123 @@
+#pragma once
+
+#include <QPixmap>
+#include <QRect>
+#include <QHash>
+#include <list>
+
+class DocumentReader;
+
+/**
+ * Identifies one rendered page bitmap, or one tile of a page.
+ * The DPI is stored in hundredths of a dot so that keys compare exactly.
+ * Tiles are given in pixels at that DPI; a null tile means the whole page.
+ */
+struct RenderKey
+{
+    const DocumentReader* document = nullptr;
+    int pageIndex = -1;
+    int dpiCenti = 0;
+    int hints = 0;
+    QRect tile;
+
+    RenderKey() = default;
+    RenderKey(const DocumentReader* doc, int page, double dpi, int renderHints = 0,
+              const QRect& tileRect = QRect());
+
+    double dpi() const { return dpiCenti / 100.0; }
+    bool isValid() const { return document != nullptr && pageIndex >= 0; }
+    bool isTile() const { return !tile.isNull(); }
+
+    bool operator==(const RenderKey& other) const = default;
+};
+
+size_t qHash(const RenderKey& key, size_t seed = 0);
+
+/**
+ * Memory-budgeted LRU cache of rendered page bitmaps.
+ * Entries are charged by their pixel data size; the least recently used
+ * entries are evicted once the total exceeds the configured budget.
+ * The cache is not thread-safe and is meant to be used from the GUI thread.
+ */
+class RenderCache
+{
+public:
+    struct Stats
+    {
+        quint64 hits = 0;
+        quint64 misses = 0;
+        quint64 evictions = 0;
+        qint64 bytes = 0;
+        qint64 budget = 0;
+        int entries = 0;
+
+        double hitRate() const;
+    };
+
+    explicit RenderCache(qint64 budgetBytes);
+
+    /**
+     * Look up a rendered bitmap and mark it as most recently used.
+     * Updates the hit/miss counters.
+     * @return Cached pixmap, or null pixmap on a miss
+     */
+    QPixmap find(const RenderKey& key);
+
+    /**
+     * Look up a rendered bitmap without touching the LRU order or the
+     * counters. Meant for repainting what is already on screen.
+     */
+    QPixmap peek(const RenderKey& key) const;
+
+    /**
+     * Find the whole-page render of a page whose DPI is closest to the
+     * given one, for use as a scaled stand-in while the exact render is
+     * pending. Does not touch the LRU order or the counters.
+     * @return Closest pixmap, or null pixmap if the page has no render
+     */
+    QPixmap closest(const RenderKey& key) const;
+
+    /**
+     * Check for an entry without touching the LRU order or the counters.
+     */
+    bool contains(const RenderKey& key) const;
+
+    /**
+     * Insert or replace a bitmap. Bitmaps larger than the whole budget
+     * are not cached.
+     */
+    void insert(const RenderKey& key, const QPixmap& pixmap);
+
+    /**
+     * Drop every entry belonging to the given document.
+     */
+    void removeDocument(const DocumentReader* document);
+    void clear();
+
+    void setBudget(qint64 bytes);
+    qint64 budget() const;
+
+    Stats stats() const;
+    void resetStats();
+
+    static qint64 costOf(const QPixmap& pixmap);
+
+private:
+    struct Entry
+    {
+        RenderKey key;
+        QPixmap pixmap;
+        qint64 cost;
+    };
+    using EntryList = std::list<Entry>;
+
+    void evictToBudget(qint64 budget);
+
+    EntryList m_entries; // Front is most recently used
+    QHash<RenderKey, EntryList::iterator> m_index;
+    qint64 m_budget;
+    qint64 m_bytes;
+    quint64 m_hits;
+    quint64 m_misses;
+    quint64 m_evictions;
+};
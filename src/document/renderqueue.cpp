@@ -0,0 +1,98 @@
+#include "renderqueue.h"
+#include "documentreader.h"
+#include <QRunnable>
+
+RenderQueue::RenderQueue(QObject* parent)
+    : QObject(parent)
+{
+}
+
+RenderQueue::~RenderQueue()
+{
+    cancelAll();
+    waitForDone();
+}
+
+void RenderQueue::request(const RenderKey& key, int priority)
+{
+    request(key, priority, [key](const std::atomic_bool* cancelled) {
+        return key.document->renderImage(key.pageIndex, key.dpi(), key.tile, cancelled);
+    });
+}
+
+void RenderQueue::request(const RenderKey& key, int priority,
+                          const std::function<QImage(const std::atomic_bool*)>& render)
+{
+    if (!key.isValid() || m_pending.contains(key)) {
+        return;
+    }
+
+    CancelFlag flag = std::make_shared<std::atomic_bool>(false);
+    m_pending.insert(key, flag);
+
+    m_pool.start(QRunnable::create([this, key, flag, render]() {
+        if (flag->load()) {
+            return; // Dropped before it started
+        }
+
+        QImage image = render(flag.get());
+
+        QMetaObject::invokeMethod(this, [this, key, flag, image]() {
+            finish(key, flag, image);
+        }, Qt::QueuedConnection);
+    }), priority);
+}
+
+void RenderQueue::setMaxThreadCount(int count)
+{
+    m_pool.setMaxThreadCount(count);
+}
+
+int RenderQueue::pendingCount() const
+{
+    return m_pending.size();
+}
+
+bool RenderQueue::isPending(const RenderKey& key) const
+{
+    return m_pending.contains(key);
+}
+
+void RenderQueue::cancelIf(const std::function<bool(const RenderKey&)>& predicate)
+{
+    for (auto it = m_pending.begin(); it != m_pending.end();) {
+        if (predicate(it.key())) {
+            it.value()->store(true);
+            it = m_pending.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+void RenderQueue::cancelAll()
+{
+    cancelIf([](const RenderKey&) { return true; });
+}
+
+void RenderQueue::waitForDone()
+{
+    m_pool.waitForDone();
+}
+
+void RenderQueue::finish(const RenderKey& key, const CancelFlag& flag, const QImage& image)
+{
+    // A cancelled job may have been re-requested in the meantime; only the
+    // job currently registered for the key is allowed to complete it
+    auto it = m_pending.find(key);
+    if (it == m_pending.end() || it.value() != flag) {
+        return;
+    }
+    m_pending.erase(it);
+
+    if (flag->load()) {
+        return;
+    }
+
+    emit rendered(key, image);
+}
@@ -0,0 +1,88 @@
+#pragma once
+
+#include "rendercache.h"
+#include <QObject>
+#include <QImage>
+#include <QHash>
+#include <QThreadPool>
+#include <atomic>
+#include <functional>
+#include <memory>
+
+/**
+ * Renders document pages on a pool of worker threads.
+ * Each request is identified by its RenderKey; duplicate requests are merged.
+ * Requests that are no longer wanted can be cancelled, in which case they are
+ * either dropped before they start or aborted while rendering.
+ * Results are delivered on the thread that owns the queue (the GUI thread).
+ */
+class RenderQueue : public QObject
+{
+    Q_OBJECT
+
+public:
+    // Priority bands: cheap previews first, then visible pages, then
+    // speculative work
+    static constexpr int PreviewPriority = 150;
+    static constexpr int VisiblePriority = 100;
+    static constexpr int PrefetchPriority = 50;
+
+    explicit RenderQueue(QObject* parent = nullptr);
+    ~RenderQueue() override;
+
+    /**
+     * Queue a render job unless one for the same key is already pending.
+     * @param key Page, DPI and document to render
+     * @param priority Higher priorities are started first
+     */
+    void request(const RenderKey& key, int priority = 0);
+
+    /**
+     * Queue a job that produces the image for a key some other way than
+     * DocumentReader::renderImage(), e.g. a thumbnail.
+     * @param key Identifies the job; duplicates and cancellation work as above
+     * @param priority Higher priorities are started first
+     * @param render Called on a worker thread with the job's cancel flag
+     */
+    void request(const RenderKey& key, int priority,
+                 const std::function<QImage(const std::atomic_bool*)>& render);
+
+    /**
+     * Number of jobs queued or running.
+     */
+    int pendingCount() const;
+
+    /**
+     * Limit how many jobs run at the same time.
+     * @param count Number of worker threads; defaults to the number of cores
+     */
+    void setMaxThreadCount(int count);
+
+    /**
+     * Check whether a job for the given key is queued or running.
+     */
+    bool isPending(const RenderKey& key) const;
+
+    /**
+     * Cancel every pending job whose key matches the predicate.
+     */
+    void cancelIf(const std::function<bool(const RenderKey&)>& predicate);
+    void cancelAll();
+
+    /**
+     * Block until all running jobs have finished.
+     * Call after cancelling before the document they render is destroyed.
+     */
+    void waitForDone();
+
+signals:
+    void rendered(const RenderKey& key, const QImage& image);
+
+private:
+    using CancelFlag = std::shared_ptr<std::atomic_bool>;
+
+    void finish(const RenderKey& key, const CancelFlag& flag, const QImage& image);
+
+    QThreadPool m_pool;
+    QHash<RenderKey, CancelFlag> m_pending;
+};
@@ -0,0 +1,107 @@
+#include "searchsession.h"
+#include "documentreader.h"
+#include <QRunnable>
+#include <algorithm>
+
+SearchSession::SearchSession(QObject* parent)
+    : QObject(parent)
+    , m_generation(0)
+    , m_running(false)
+{
+    // One search at a time; a new one queues behind the cancelled one,
+    // which gives up at the next page
+    m_pool.setMaxThreadCount(1);
+}
+
+SearchSession::~SearchSession()
+{
+    cancel();
+    waitForDone();
+}
+
+void SearchSession::start(const DocumentReader* document, const QString& text, bool caseSensitive, int startPage)
+{
+    cancel();
+
+    if (!document || !document->isLoaded() || text.isEmpty()) {
+        return;
+    }
+
+    int pageCount = document->pageCount();
+    startPage = std::clamp(startPage, 0, std::max(0, pageCount - 1));
+
+    CancelFlag flag = std::make_shared<std::atomic_bool>(false);
+    quint64 generation = m_generation;
+    m_cancelled = flag;
+    m_running = true;
+    m_text = text;
+
+    // Posts a result back to this thread unless a newer search replaced
+    // the one that produced it
+    auto post = [this, generation](auto&& deliver) {
+        QMetaObject::invokeMethod(this, [this, generation, deliver]() {
+            if (generation == m_generation) {
+                deliver();
+            }
+        }, Qt::QueuedConnection);
+    };
+
+    m_pool.start(QRunnable::create([this, flag, post, document, text, caseSensitive, startPage, pageCount]() {
+        int searched = 0;
+        int matched = 0;
+
+        for (int step = 0; step < 2 * pageCount; ++step) {
+            if (flag->load()) {
+                return;
+            }
+
+            // start, start + 1, start - 1, start + 2, start - 2, ...
+            int offset = (step + 1) / 2;
+            int page = step % 2 ? startPage + offset : startPage - offset;
+            if (page < 0 || page >= pageCount) {
+                continue;
+            }
+
+            QList<QRectF> hits = document->searchPage(page, text, caseSensitive);
+            ++searched;
+            if (!hits.isEmpty()) {
+                ++matched;
+                post([this, page, hits]() { emit pageMatched(page, hits); });
+            }
+            if (searched % PROGRESS_INTERVAL == 0) {
+                post([this, searched, pageCount]() { emit progress(searched, pageCount); });
+            }
+        }
+
+        post([this, matched, pageCount]() {
+            m_running = false;
+            emit progress(pageCount, pageCount);
+            emit finished(matched);
+        });
+    }));
+}
+
+void SearchSession::cancel()
+{
+    if (m_cancelled) {
+        m_cancelled->store(true);
+        m_cancelled.reset();
+    }
+    ++m_generation;
+    m_running = false;
+}
+
+void SearchSession::waitForDone()
+{
+    m_pool.waitForDone();
+}
+
+bool SearchSession::isRunning() const
+{
+    return m_running;
+}
+
+QString SearchSession::text() const
+{
+    return m_text;
+}
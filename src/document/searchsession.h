@@ -0,0 +1,70 @@
+#pragma once
+
+#include <QList>
+#include <QObject>
+#include <QRectF>
+#include <QString>
+#include <QThreadPool>
+#include <atomic>
+#include <memory>
+
+class DocumentReader;
+
+/**
+ * Searches a document page by page on a worker thread and reports every
+ * page with hits as soon as it has been searched.
+ *
+ * The search starts at a given page and works outward from it, alternating
+ * between the pages after and before, so hits near what the user is looking
+ * at arrive first. Starting a new search or calling cancel() stops the
+ * previous one; results it had already produced are discarded.
+ * Signals are delivered on the thread that owns the session.
+ */
+class SearchSession : public QObject
+{
+    Q_OBJECT
+
+public:
+    explicit SearchSession(QObject* parent = nullptr);
+    ~SearchSession() override;
+
+    /**
+     * Start searching, cancelling any search in progress.
+     * @param document Document to search; must outlive the search
+     * @param text Text to search for
+     * @param caseSensitive Whether search should be case sensitive
+     * @param startPage Page to start at
+     */
+    void start(const DocumentReader* document, const QString& text, bool caseSensitive, int startPage);
+
+    /**
+     * Stop the current search. No further signals are emitted for it.
+     */
+    void cancel();
+
+    /**
+     * Block until the worker has stopped.
+     * Call after cancel() before the searched document is destroyed.
+     */
+    void waitForDone();
+
+    bool isRunning() const;
+    QString text() const;
+
+signals:
+    void pageMatched(int pageIndex, const QList<QRectF>& hits);
+    void progress(int pagesSearched, int pageCount);
+    void finished(int matchedPages);
+
+private:
+    using CancelFlag = std::shared_ptr<std::atomic_bool>;
+
+    QThreadPool m_pool;
+    CancelFlag m_cancelled;
+    quint64 m_generation; // Results of older searches are dropped on arrival
+    bool m_running;
+    QString m_text;
+
+    // Pages searched between progress reports
+    static constexpr int PROGRESS_INTERVAL = 16;
+};
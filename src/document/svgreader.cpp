@@ -0,0 +1,194 @@
+#include "svgreader.h"
+#include "mappedfile.h"
+#include <QDebug>
+#include <QFileInfo>
+#include <QMutexLocker>
+#include <QPainter>
+#include <cmath>
+
+SvgReader::SvgReader()
+{
+}
+
+bool SvgReader::load(const QString& filePath)
+{
+    close();
+    
+    // Parsed once from the mapped file; only the tree is kept
+    std::shared_ptr<const MappedFile> file = MappedFile::open(filePath);
+    auto renderer = std::make_unique<QSvgRenderer>();
+    bool parsed = file ? renderer->load(file->bytes()) : renderer->load(filePath);
+    if (!parsed || !renderer->isValid()) {
+        qWarning() << "Failed to load SVG document:" << filePath;
+        return false;
+    }
+    
+    QSizeF size = renderer->defaultSize();
+    if (size.isEmpty()) {
+        size = renderer->viewBoxF().size();
+    }
+    if (size.isEmpty()) {
+        qWarning() << "SVG document has no size:" << filePath;
+        return false;
+    }
+    
+    // Pages are still images; no animation timer
+    renderer->setFramesPerSecond(0);
+    
+    QMutexLocker locker(&m_mutex);
+    m_filePath = filePath;
+    m_file = file;
+    m_size = size;
+    m_renderer = std::move(renderer);
+    return true;
+}
+
+void SvgReader::close()
+{
+    QMutexLocker locker(&m_mutex);
+    m_renderer.reset();
+    m_renders.clear();
+    m_file.reset();
+    m_filePath.clear();
+    m_size = QSizeF();
+}
+
+bool SvgReader::isLoaded() const
+{
+    return !m_size.isEmpty();
+}
+
+int SvgReader::pageCount() const
+{
+    return isLoaded() ? 1 : 0;
+}
+
+QPixmap SvgReader::renderPage(int pageIndex, double dpi) const
+{
+    QImage image = renderImage(pageIndex, dpi);
+    if (image.isNull()) {
+        return QPixmap();
+    }
+    
+    return QPixmap::fromImage(image);
+}
+
+QImage SvgReader::renderImage(int pageIndex, double dpi, const QRect& region,
+                              const std::atomic_bool* cancelled) const
+{
+    if (!isLoaded() || pageIndex != 0 || dpi <= 0 || (cancelled && cancelled->load())) {
+        return QImage();
+    }
+    
+    double scaleFactor = dpi / 72.0;
+    QSize fullSize(static_cast<int>(m_size.width() * scaleFactor),
+                   static_cast<int>(m_size.height() * scaleFactor));
+    QRect target = region.isNull() ? QRect(QPoint(0, 0), fullSize)
+                                   : region.intersected(QRect(QPoint(0, 0), fullSize));
+    if (target.isEmpty()) {
+        return QImage();
+    }
+    
+    int dpiCenti = qRound(dpi * 100);
+    
+    QMutexLocker locker(&m_mutex);
+    if (!m_renderer) {
+        return QImage();
+    }
+    
+    for (auto it = m_renders.begin(); it != m_renders.end(); ++it) {
+        if (it->dpiCenti == dpiCenti && it->region == region) {
+            m_renders.splice(m_renders.begin(), m_renders, it);
+            return it->image;
+        }
+    }
+    
+    // Waiting for the lock may have taken a while
+    if (cancelled && cancelled->load()) {
+        return QImage();
+    }
+    
+    // Drawn at the output resolution; for a tile, the whole document is
+    // laid out at full size and shifted so only the tile lands in the image
+    QImage image(target.size(), QImage::Format_ARGB32_Premultiplied);
+    image.fill(Qt::transparent);
+    QPainter painter(&image);
+    painter.setRenderHint(QPainter::Antialiasing);
+    painter.setRenderHint(QPainter::SmoothPixmapTransform);
+    painter.translate(-target.topLeft());
+    m_renderer->render(&painter, QRectF(QPointF(0, 0), QSizeF(fullSize)));
+    painter.end();
+    
+    m_renders.push_front(CachedRender{dpiCenti, region, image});
+    if (m_renders.size() > RENDER_CACHE_SIZE) {
+        m_renders.pop_back();
+    }
+    return image;
+}
+
+QSizeF SvgReader::pageSize(int pageIndex) const
+{
+    if (!isLoaded() || pageIndex != 0) {
+        return QSizeF();
+    }
+    
+    return m_size;
+}
+
+std::shared_ptr<const MappedFile> SvgReader::mappedFile() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_file;
+}
+
+QString SvgReader::title() const
+{
+    if (!isLoaded()) {
+        return QString();
+    }
+    
+    return QFileInfo(m_filePath).baseName();
+}
+
+QString SvgReader::author() const
+{
+    return QString();
+}
+
+QString SvgReader::subject() const
+{
+    return QString();
+}
+
+QString SvgReader::creator() const
+{
+    return "SVG Viewer";
+}
+
+QString SvgReader::producer() const
+{
+    return "DocumentReader";
+}
+
+QString SvgReader::filePath() const
+{
+    return m_filePath;
+}
+
+bool SvgReader::supportsTextExtraction() const
+{
+    return false;
+}
+
+QString SvgReader::extractText(int pageIndex) const
+{
+    Q_UNUSED(pageIndex)
+    return QString();
+}
+
+QList<int> SvgReader::searchText(const QString& searchText, bool caseSensitive) const
+{
+    Q_UNUSED(searchText)
+    Q_UNUSED(caseSensitive)
+    return QList<int>();
+}
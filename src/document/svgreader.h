@@ -0,0 +1,63 @@
+#pragma once
+
+#include "documentreader.h"
+#include <QImage>
+#include <QMutex>
+#include <QSvgRenderer>
+#include <list>
+#include <memory>
+
+/**
+ * SVG document reader.
+ * The parsed document is kept in memory and every render is drawn by
+ * QSvgRenderer straight at the requested resolution, so zooming in stays
+ * sharp and a tile costs only its own pixels. The last few rasterizations
+ * are kept, since the same page is asked for at the same DPI repeatedly.
+ */
+class SvgReader : public DocumentReader
+{
+public:
+    SvgReader();
+    ~SvgReader() override = default;
+    
+    // DocumentReader interface implementation
+    bool load(const QString& filePath) override;
+    void close() override;
+    bool isLoaded() const override;
+    int pageCount() const override;
+    QPixmap renderPage(int pageIndex, double dpi = 72.0) const override;
+    QImage renderImage(int pageIndex, double dpi = 72.0, const QRect& region = QRect(),
+                       const std::atomic_bool* cancelled = nullptr) const override;
+    QSizeF pageSize(int pageIndex) const override;
+    std::shared_ptr<const MappedFile> mappedFile() const override;
+    
+    QString title() const override;
+    QString author() const override;
+    QString subject() const override;
+    QString creator() const override;
+    QString producer() const override;
+    QString filePath() const override;
+    
+    bool supportsTextExtraction() const override;
+    QString extractText(int pageIndex) const override;
+    QList<int> searchText(const QString& searchText, bool caseSensitive = false) const override;
+    
+private:
+    QString m_filePath;
+    std::shared_ptr<const MappedFile> m_file;
+    QSizeF m_size; // Intrinsic size; one SVG pixel is one point, as for images
+    
+    // QSvgRenderer is not safe for concurrent use; renders take turns
+    mutable QMutex m_mutex;
+    std::unique_ptr<QSvgRenderer> m_renderer;
+    
+    // Recent rasterizations, most recent first. Guarded by m_mutex.
+    struct CachedRender {
+        int dpiCenti;
+        QRect region;
+        QImage image;
+    };
+    mutable std::list<CachedRender> m_renders;
+    
+    static constexpr int RENDER_CACHE_SIZE = 8;
+};
@@ -0,0 +1,243 @@
+#include "textindex.h"
+#include "textsearch.h"
+#include <QMutexLocker>
+#include <QReadLocker>
+#include <QWriteLocker>
+#include <algorithm>
+#include <iterator>
+
+TextIndex::TextIndex()
+    : m_indexedCount(0)
+    , m_lastCaseSensitive(false)
+    , m_lastIndexedCount(-1)
+{
+}
+
+void TextIndex::reset(int pageCount)
+{
+    QWriteLocker locker(&m_lock);
+    m_text.assign(pageCount, QString());
+    m_folded.assign(pageCount, QString());
+    m_indexed.assign(pageCount, false);
+    m_indexedCount = 0;
+    m_tokens.clear();
+
+    QMutexLocker memo(&m_memoMutex);
+    m_lastQuery.clear();
+    m_lastResults.clear();
+    m_lastIndexedCount = -1;
+}
+
+void TextIndex::addPage(int pageIndex, const QString& text)
+{
+    // Folding and tokenizing happen outside the lock so searches keep
+    // running while a page is being added
+    QString folded = text.toCaseFolded();
+    QStringList tokens = tokenize(folded);
+    tokens.removeDuplicates();
+
+    QWriteLocker locker(&m_lock);
+    if (pageIndex < 0 || pageIndex >= static_cast<int>(m_indexed.size()) || m_indexed[pageIndex]) {
+        return;
+    }
+
+    m_text[pageIndex] = text;
+    m_folded[pageIndex] = folded;
+    m_indexed[pageIndex] = true;
+    ++m_indexedCount;
+
+    for (const QString& token : tokens) {
+        QList<int>& pages = m_tokens[token];
+        if (pages.isEmpty() || pages.last() < pageIndex) {
+            pages.append(pageIndex); // The usual case, pages arrive in order
+        } else {
+            pages.insert(std::lower_bound(pages.begin(), pages.end(), pageIndex), pageIndex);
+        }
+    }
+}
+
+int TextIndex::pageCount() const
+{
+    QReadLocker locker(&m_lock);
+    return static_cast<int>(m_indexed.size());
+}
+
+int TextIndex::indexedPageCount() const
+{
+    QReadLocker locker(&m_lock);
+    return m_indexedCount;
+}
+
+bool TextIndex::isComplete() const
+{
+    QReadLocker locker(&m_lock);
+    return m_indexedCount == static_cast<int>(m_indexed.size());
+}
+
+bool TextIndex::hasPage(int pageIndex) const
+{
+    QReadLocker locker(&m_lock);
+    return pageIndex >= 0 && pageIndex < static_cast<int>(m_indexed.size()) && m_indexed[pageIndex];
+}
+
+QString TextIndex::pageText(int pageIndex) const
+{
+    QReadLocker locker(&m_lock);
+    if (pageIndex < 0 || pageIndex >= static_cast<int>(m_indexed.size()) || !m_indexed[pageIndex]) {
+        return QString();
+    }
+    return m_text[pageIndex];
+}
+
+QString TextIndex::foldedPageText(int pageIndex) const
+{
+    QReadLocker locker(&m_lock);
+    if (pageIndex < 0 || pageIndex >= static_cast<int>(m_indexed.size()) || !m_indexed[pageIndex]) {
+        return QString();
+    }
+    return m_folded[pageIndex];
+}
+
+bool TextIndex::mayContain(int pageIndex, const QString& query) const
+{
+    // Words rather than the whole query, so that differences in spacing
+    // and line breaks between extractors never rule a page out
+    QStringList tokens = tokenize(query.toCaseFolded());
+
+    QReadLocker locker(&m_lock);
+    if (pageIndex < 0 || pageIndex >= static_cast<int>(m_indexed.size()) || !m_indexed[pageIndex]) {
+        return true;
+    }
+    for (const QString& token : tokens) {
+        if (!TextSearch::contains(m_folded[pageIndex], token)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+QList<int> TextIndex::search(const QString& query, bool caseSensitive) const
+{
+    if (query.isEmpty()) {
+        return QList<int>();
+    }
+
+    QString folded = query.toCaseFolded();
+    QString memoKey = caseSensitive ? query : folded;
+
+    QReadLocker locker(&m_lock);
+
+    QList<int> candidates;
+    bool haveCandidates = false;
+    {
+        QMutexLocker memo(&m_memoMutex);
+        if (!m_lastQuery.isEmpty() && m_lastCaseSensitive == caseSensitive
+            && m_lastIndexedCount == m_indexedCount && memoKey.contains(m_lastQuery)) {
+            candidates = m_lastResults;
+            haveCandidates = true;
+        }
+    }
+    if (!haveCandidates) {
+        candidates = candidatePages(tokenize(folded));
+    }
+
+    // The word index only narrows things down; the cached text decides
+    QList<int> results;
+    for (int page : candidates) {
+        bool found = caseSensitive
+            ? TextSearch::contains(m_text[page], query)
+            : TextSearch::contains(m_folded[page], folded);
+        if (found) {
+            results.append(page);
+        }
+    }
+
+    QMutexLocker memo(&m_memoMutex);
+    m_lastQuery = memoKey;
+    m_lastCaseSensitive = caseSensitive;
+    m_lastIndexedCount = m_indexedCount;
+    m_lastResults = results;
+
+    return results;
+}
+
+QStringList TextIndex::tokenize(const QString& foldedText)
+{
+    QStringList tokens;
+    qsizetype start = -1;
+    for (qsizetype i = 0; i <= foldedText.size(); ++i) {
+        bool wordChar = i < foldedText.size() && foldedText.at(i).isLetterOrNumber();
+        if (wordChar && start < 0) {
+            start = i;
+        } else if (!wordChar && start >= 0) {
+            tokens.append(foldedText.mid(start, i - start));
+            start = -1;
+        }
+    }
+    return tokens;
+}
+
+QList<int> TextIndex::candidatePages(const QStringList& tokens) const
+{
+    if (tokens.isEmpty()) {
+        // Only separators in the query; every indexed page is a candidate
+        QList<int> pages;
+        for (int i = 0; i < static_cast<int>(m_indexed.size()); ++i) {
+            if (m_indexed[i]) {
+                pages.append(i);
+            }
+        }
+        return pages;
+    }
+
+    // Where a query lands inside the page text, its inner words are whole
+    // page words, its first word ends a page word and its last word starts
+    // one. A single word can sit anywhere inside a page word.
+    std::vector<QList<int>> sets;
+    for (int i = 0; i < tokens.size(); ++i) {
+        const QString& token = tokens[i];
+        if (tokens.size() == 1) {
+            sets.push_back(pagesWithTokens([&token](const QString& word) { return word.contains(token); }));
+        } else if (i == 0) {
+            sets.push_back(pagesWithTokens([&token](const QString& word) { return word.endsWith(token); }));
+        } else if (i == tokens.size() - 1) {
+            sets.push_back(pagesWithTokens([&token](const QString& word) { return word.startsWith(token); }));
+        } else {
+            sets.push_back(m_tokens.value(token));
+        }
+    }
+
+    // Intersect, smallest set first
+    std::sort(sets.begin(), sets.end(), [](const QList<int>& a, const QList<int>& b) {
+        return a.size() < b.size();
+    });
+    QList<int> pages = sets.front();
+    for (size_t i = 1; i < sets.size() && !pages.isEmpty(); ++i) {
+        QList<int> both;
+        std::set_intersection(pages.begin(), pages.end(), sets[i].begin(), sets[i].end(),
+                              std::back_inserter(both));
+        pages = both;
+    }
+    return pages;
+}
+
+QList<int> TextIndex::pagesWithTokens(const std::function<bool(const QString&)>& matches) const
+{
+    // Scans the vocabulary, which is far smaller than the text
+    std::vector<bool> hit(m_indexed.size(), false);
+    for (auto it = m_tokens.cbegin(); it != m_tokens.cend(); ++it) {
+        if (matches(it.key())) {
+            for (int page : it.value()) {
+                hit[page] = true;
+            }
+        }
+    }
+
+    QList<int> pages;
+    for (int i = 0; i < static_cast<int>(hit.size()); ++i) {
+        if (hit[i]) {
+            pages.append(i);
+        }
+    }
+    return pages;
+}
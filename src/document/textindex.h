@@ -0,0 +1,97 @@
+#pragma once
+
+#include <QHash>
+#include <QList>
+#include <QMutex>
+#include <QReadWriteLock>
+#include <QString>
+#include <QStringList>
+#include <functional>
+#include <vector>
+
+/**
+ * In-memory full-text index of one document.
+ *
+ * Pages are added one at a time, typically by a background thread right
+ * after the document is loaded, and can be searched at any point; queries
+ * only see the pages indexed so far. For every page the index keeps the
+ * extracted text and its case-folded form, plus an inverted index from
+ * case-folded word to the pages containing it. A query first narrows the
+ * pages down through the word index and then confirms each candidate with
+ * a substring match on the cached text, so results are the same as
+ * QString::contains() on the page text, without touching the document.
+ *
+ * Thread-safe.
+ */
+class TextIndex
+{
+public:
+    TextIndex();
+
+    /**
+     * Drop all content and prepare for a document with the given pages.
+     */
+    void reset(int pageCount);
+
+    /**
+     * Add the text of one page. Adding a page twice replaces nothing.
+     */
+    void addPage(int pageIndex, const QString& text);
+
+    int pageCount() const;
+    int indexedPageCount() const;
+    bool isComplete() const;
+    bool hasPage(int pageIndex) const;
+
+    /**
+     * Get the cached text of an indexed page.
+     * @return Page text as extracted, or a null string if not indexed yet
+     */
+    QString pageText(int pageIndex) const;
+
+    /**
+     * Get the case-folded text of an indexed page, ready for
+     * TextSearch::contains() with a folded query.
+     * @return Folded page text, or a null string if not indexed yet
+     */
+    QString foldedPageText(int pageIndex) const;
+
+    /**
+     * Cheap pre-check before searching a page some other way.
+     * @return false only if the page is indexed and lacks one of the words
+     *         of the query; true otherwise
+     */
+    bool mayContain(int pageIndex, const QString& query) const;
+
+    /**
+     * Find the indexed pages containing a string.
+     * @param query Text to search for
+     * @param caseSensitive Whether search should be case sensitive
+     * @return Ascending indices of matching pages among the indexed ones
+     */
+    QList<int> search(const QString& query, bool caseSensitive = false) const;
+
+    /**
+     * Split case-folded text into the words the inverted index is keyed by.
+     */
+    static QStringList tokenize(const QString& foldedText);
+
+private:
+    QList<int> candidatePages(const QStringList& tokens) const;
+    QList<int> pagesWithTokens(const std::function<bool(const QString&)>& matches) const;
+
+    mutable QReadWriteLock m_lock;
+    std::vector<QString> m_text;
+    std::vector<QString> m_folded;
+    std::vector<bool> m_indexed;
+    int m_indexedCount;
+    QHash<QString, QList<int>> m_tokens; // Word -> ascending page indices
+
+    // Type-ahead: a query that extends the previous one can only match
+    // pages the previous one matched
+    mutable QMutex m_memoMutex;
+    mutable QString m_lastQuery; // Case-folded unless m_lastCaseSensitive
+    mutable bool m_lastCaseSensitive;
+    mutable int m_lastIndexedCount;
+    mutable QList<int> m_lastResults;
+};
@@ -0,0 +1,163 @@
+#include "textsearch.h"
+#include <bit>
+#include <cstring>
+#include <string_view>
+
+#if defined(__x86_64__) || defined(_M_X64)
+#define TEXTSEARCH_X86_64
+#include <immintrin.h>
+#if defined(_MSC_VER) && !defined(__clang__)
+#include <intrin.h>
+#define TEXTSEARCH_AVX2_TARGET
+#else
+#define TEXTSEARCH_AVX2_TARGET __attribute__((target("avx2")))
+#endif
+#endif
+
+namespace {
+
+qsizetype indexOfScalar(const char16_t* haystack, qsizetype haystackSize,
+                        const char16_t* needle, qsizetype needleSize)
+{
+    std::u16string_view text(haystack, static_cast<size_t>(haystackSize));
+    size_t pos = text.find(std::u16string_view(needle, static_cast<size_t>(needleSize)));
+    return pos == std::u16string_view::npos ? -1 : static_cast<qsizetype>(pos);
+}
+
+// Checks the code units between the first and the last, which the vector
+// compare has already matched
+inline bool middleMatches(const char16_t* candidate, const char16_t* needle, qsizetype needleSize)
+{
+    return needleSize <= 2
+        || std::memcmp(candidate + 1, needle + 1, static_cast<size_t>(needleSize - 2) * sizeof(char16_t)) == 0;
+}
+
+#ifdef TEXTSEARCH_X86_64
+
+// Both kernels compare a block of positions at once against the needle's
+// first and last code unit and only look at the rest where both match,
+// which in ordinary text is rare.
+
+qsizetype indexOfSse(const char16_t* haystack, qsizetype haystackSize,
+                     const char16_t* needle, qsizetype needleSize)
+{
+    constexpr qsizetype Lanes = 8;
+    const __m128i first = _mm_set1_epi16(static_cast<short>(needle[0]));
+    const __m128i last = _mm_set1_epi16(static_cast<short>(needle[needleSize - 1]));
+
+    qsizetype i = 0;
+    for (; i + needleSize - 1 + Lanes <= haystackSize; i += Lanes) {
+        __m128i blockFirst = _mm_loadu_si128(reinterpret_cast<const __m128i*>(haystack + i));
+        __m128i blockLast = _mm_loadu_si128(reinterpret_cast<const __m128i*>(haystack + i + needleSize - 1));
+        __m128i both = _mm_and_si128(_mm_cmpeq_epi16(blockFirst, first), _mm_cmpeq_epi16(blockLast, last));
+
+        // Two mask bits per code unit
+        unsigned mask = static_cast<unsigned>(_mm_movemask_epi8(both));
+        while (mask) {
+            int bit = std::countr_zero(mask);
+            qsizetype pos = i + bit / 2;
+            if (middleMatches(haystack + pos, needle, needleSize)) {
+                return pos;
+            }
+            mask &= ~(3u << bit);
+        }
+    }
+
+    qsizetype tail = indexOfScalar(haystack + i, haystackSize - i, needle, needleSize);
+    return tail < 0 ? -1 : i + tail;
+}
+
+TEXTSEARCH_AVX2_TARGET
+qsizetype indexOfAvx2(const char16_t* haystack, qsizetype haystackSize,
+                      const char16_t* needle, qsizetype needleSize)
+{
+    constexpr qsizetype Lanes = 16;
+    const __m256i first = _mm256_set1_epi16(static_cast<short>(needle[0]));
+    const __m256i last = _mm256_set1_epi16(static_cast<short>(needle[needleSize - 1]));
+
+    qsizetype i = 0;
+    for (; i + needleSize - 1 + Lanes <= haystackSize; i += Lanes) {
+        __m256i blockFirst = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(haystack + i));
+        __m256i blockLast = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(haystack + i + needleSize - 1));
+        __m256i both = _mm256_and_si256(_mm256_cmpeq_epi16(blockFirst, first),
+                                        _mm256_cmpeq_epi16(blockLast, last));
+
+        unsigned mask = static_cast<unsigned>(_mm256_movemask_epi8(both));
+        while (mask) {
+            int bit = std::countr_zero(mask);
+            qsizetype pos = i + bit / 2;
+            if (middleMatches(haystack + pos, needle, needleSize)) {
+                return pos;
+            }
+            mask &= ~(3u << bit);
+        }
+    }
+
+    // Finish with the narrower kernel rather than falling to scalar
+    qsizetype tail = indexOfSse(haystack + i, haystackSize - i, needle, needleSize);
+    return tail < 0 ? -1 : i + tail;
+}
+
+bool cpuHasAvx2()
+{
+#if defined(_MSC_VER) && !defined(__clang__)
+    int info[4];
+    __cpuid(info, 1);
+    bool osSavesYmm = (info[2] & (1 << 27)) && (info[2] & (1 << 28)) && (_xgetbv(0) & 6) == 6;
+    if (!osSavesYmm) {
+        return false;
+    }
+    __cpuidex(info, 7, 0);
+    return (info[1] & (1 << 5)) != 0;
+#else
+    return __builtin_cpu_supports("avx2");
+#endif
+}
+
+#endif // TEXTSEARCH_X86_64
+
+} // namespace
+
+qsizetype TextSearch::indexOf(const char16_t* haystack, qsizetype haystackSize,
+                              const char16_t* needle, qsizetype needleSize)
+{
+    return indexOf(kernel(), haystack, haystackSize, needle, needleSize);
+}
+
+qsizetype TextSearch::indexOf(Kernel kernel, const char16_t* haystack, qsizetype haystackSize,
+                              const char16_t* needle, qsizetype needleSize)
+{
+    if (needleSize == 0) {
+        return 0;
+    }
+    if (needleSize > haystackSize) {
+        return -1;
+    }
+
+    switch (kernel) {
+#ifdef TEXTSEARCH_X86_64
+    case Kernel::AVX2:
+        return indexOfAvx2(haystack, haystackSize, needle, needleSize);
+    case Kernel::SSE:
+        return indexOfSse(haystack, haystackSize, needle, needleSize);
+#endif
+    default:
+        return indexOfScalar(haystack, haystackSize, needle, needleSize);
+    }
+}
+
+bool TextSearch::contains(const QString& text, const QString& needle)
+{
+    return indexOf(reinterpret_cast<const char16_t*>(text.utf16()), text.size(),
+                   reinterpret_cast<const char16_t*>(needle.utf16()), needle.size()) >= 0;
+}
+
+TextSearch::Kernel TextSearch::kernel()
+{
+#ifdef TEXTSEARCH_X86_64
+    static const Kernel best = cpuHasAvx2() ? Kernel::AVX2 : Kernel::SSE;
+    return best;
+#else
+    return Kernel::Scalar;
+#endif
+}
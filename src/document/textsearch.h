@@ -0,0 +1,58 @@
+#pragma once
+
+#include <QString>
+#include <QtGlobal>
+
+/**
+ * Substring search over UTF-16 text, vectorized where the CPU allows.
+ *
+ * Case-insensitive search is done by folding both sides once with
+ * QString::toCaseFolded() and searching the folded text exactly, which is
+ * far cheaper than folding every character again on every comparison.
+ * Page text is folded when it is cached, so only the query is folded per
+ * search.
+ *
+ * The kernel is picked at first use: AVX2 when the CPU has it, SSE2 on
+ * every other x86-64 CPU, and a scalar loop elsewhere.
+ */
+class TextSearch
+{
+public:
+    enum class Kernel {
+        Scalar,
+        SSE,
+        AVX2
+    };
+
+    /**
+     * Find the first occurrence of a string.
+     * @param haystack Text to search
+     * @param haystackSize Length of the text in UTF-16 code units
+     * @param needle String to find
+     * @param needleSize Length of the string in UTF-16 code units
+     * @return Offset of the first match, or -1 if there is none
+     */
+    static qsizetype indexOf(const char16_t* haystack, qsizetype haystackSize,
+                             const char16_t* needle, qsizetype needleSize);
+
+    /**
+     * Check whether text contains a string, comparing code units exactly.
+     * For a case-insensitive search, pass both already case folded.
+     */
+    static bool contains(const QString& text, const QString& needle);
+
+    /**
+     * Kernel used by indexOf() on this machine.
+     */
+    static Kernel kernel();
+
+    /**
+     * Find using a given kernel, for comparing them. The kernel must be
+     * supported by the CPU.
+     */
+    static qsizetype indexOf(Kernel kernel, const char16_t* haystack, qsizetype haystackSize,
+                             const char16_t* needle, qsizetype needleSize);
+
+private:
+    TextSearch() = default; // Static class, no instantiation
+};
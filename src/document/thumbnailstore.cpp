@@ -0,0 +1,364 @@
+#include "thumbnailstore.h"
+#include "mappedfile.h"
+#include "../config.h"
+#include <QBuffer>
+#include <QCryptographicHash>
+#include <QDataStream>
+#include <QDateTime>
+#include <QDebug>
+#include <QDir>
+#include <QFileInfo>
+#include <QLockFile>
+#include <QMutexLocker>
+#include <QSaveFile>
+#include <QStandardPaths>
+#include <QtEndian>
+#include <algorithm>
+
+ThumbnailStore::ThumbnailStore()
+    : m_map(nullptr)
+    , m_mapSize(0)
+    , m_pageCount(0)
+{
+}
+
+ThumbnailStore::~ThumbnailStore()
+{
+    close();
+}
+
+bool ThumbnailStore::open(const QString& documentPath, int pageCount, const QSize& thumbnailSize,
+                          const std::shared_ptr<const MappedFile>& documentFile)
+{
+    close();
+
+    // Reads samples of the document; this is why stores are opened on a
+    // worker thread
+    QByteArray print = documentFile ? fingerprint(*documentFile) : fingerprint(documentPath);
+    if (print.isEmpty() || pageCount <= 0) {
+        return false;
+    }
+
+    QDir dir(cacheDirectory());
+    if (!dir.mkpath(".")) {
+        qWarning() << "Cannot create thumbnail cache directory:" << dir.path();
+        return false;
+    }
+
+    QString name = QString("%1-%2x%3.thumbs")
+        .arg(QString::fromLatin1(print))
+        .arg(thumbnailSize.width())
+        .arg(thumbnailSize.height());
+    pruneCacheDirectory(static_cast<qint64>(THUMBNAIL_DISK_CACHE_MB) * 1024 * 1024, name);
+
+    QMutexLocker locker(&m_mutex);
+    m_pageCount = pageCount;
+    m_thumbnailSize = thumbnailSize;
+    m_file.setFileName(dir.filePath(name));
+    if (!m_file.open(QIODevice::ReadWrite)) {
+        qWarning() << "Cannot open thumbnail cache:" << m_file.fileName();
+        reset();
+        return false;
+    }
+
+    // Another instance opening the same document must not start the
+    // container over at the same time
+    QLockFile lock(m_file.fileName() + ".lock");
+    if (!lock.tryLock(LOCK_TIMEOUT_MS)) {
+        qWarning() << "Thumbnail cache is locked:" << m_file.fileName();
+        reset();
+        return false;
+    }
+
+    // A container that does not match (older version, torn write) is
+    // simply started over
+    if (!readIndex() && !createFile()) {
+        reset();
+        return false;
+    }
+
+    return mapUpTo(m_file.size());
+}
+
+void ThumbnailStore::close()
+{
+    QMutexLocker locker(&m_mutex);
+    reset();
+}
+
+void ThumbnailStore::reset()
+{
+    if (m_map) {
+        m_file.unmap(m_map);
+        m_map = nullptr;
+    }
+    m_mapSize = 0;
+    m_file.close();
+    m_index.clear();
+    m_pageCount = 0;
+}
+
+bool ThumbnailStore::isOpen() const
+{
+    QMutexLocker locker(&m_mutex);
+    return m_file.isOpen();
+}
+
+bool ThumbnailStore::contains(int pageIndex) const
+{
+    QMutexLocker locker(&m_mutex);
+    return pageIndex >= 0 && pageIndex < static_cast<int>(m_index.size()) && m_index[pageIndex].offset != 0;
+}
+
+QImage ThumbnailStore::load(int pageIndex)
+{
+    QMutexLocker locker(&m_mutex);
+    if (pageIndex < 0 || pageIndex >= static_cast<int>(m_index.size()) || m_index[pageIndex].offset == 0) {
+        return QImage();
+    }
+
+    const IndexEntry& entry = m_index[pageIndex];
+    qint64 end = static_cast<qint64>(entry.offset) + entry.length;
+    if (!mapUpTo(end)) {
+        return QImage();
+    }
+
+    // Decodes straight from the mapping, without copying the file data
+    QImage image;
+    if (!image.loadFromData(m_map + entry.offset, static_cast<int>(entry.length), "JPG")) {
+        m_index[pageIndex] = IndexEntry();
+    }
+    return image;
+}
+
+void ThumbnailStore::save(int pageIndex, const QImage& image)
+{
+    if (image.isNull() || !isOpen() || contains(pageIndex)) {
+        return;
+    }
+
+    // Encoded without the lock; it is the slow part, and readers of other
+    // thumbnails need not wait for it
+    QByteArray data;
+    QBuffer buffer(&data);
+    buffer.open(QIODevice::WriteOnly);
+    if (!image.save(&buffer, "JPG", JPEG_QUALITY)) {
+        return;
+    }
+
+    QMutexLocker locker(&m_mutex);
+    if (!m_file.isOpen() || pageIndex < 0 || pageIndex >= m_pageCount || m_index[pageIndex].offset != 0) {
+        return; // Closed meanwhile, or saved by another worker
+    }
+
+    // Another instance may be appending to the same container; unlocked,
+    // both would claim the same offset
+    QLockFile lock(m_file.fileName() + ".lock");
+    if (!lock.tryLock(LOCK_TIMEOUT_MS)) {
+        return;
+    }
+
+    // Data first, then the index slot that points at it, so an interrupted
+    // write leaves at worst an unreferenced blob
+    qint64 offset = m_file.size();
+    if (!m_file.seek(offset) || m_file.write(data) != data.size()) {
+        qWarning() << "Failed to write thumbnail cache:" << m_file.fileName();
+        return;
+    }
+
+    m_index[pageIndex].offset = static_cast<quint64>(offset);
+    m_index[pageIndex].length = static_cast<quint32>(data.size());
+    if (!writeIndexEntry(pageIndex) || !m_file.flush()) {
+        m_index[pageIndex] = IndexEntry();
+    }
+}
+
+QByteArray ThumbnailStore::fingerprint(const QString& filePath)
+{
+    std::shared_ptr<const MappedFile> mapped = MappedFile::open(filePath);
+    if (mapped) {
+        return fingerprint(*mapped);
+    }
+
+    QFile file(filePath);
+    if (!file.open(QIODevice::ReadOnly)) {
+        return QByteArray();
+    }
+
+    return hashSamples(file.size(), QFileInfo(file).lastModified(), [&file](qint64 offset, qint64 length) {
+        return file.seek(offset) ? file.read(length) : QByteArray();
+    });
+}
+
+QByteArray ThumbnailStore::fingerprint(const MappedFile& file)
+{
+    // Only the sampled pages of the mapping are touched
+    return hashSamples(file.size(), file.lastModified(), [&file](qint64 offset, qint64 length) {
+        length = std::min(length, file.size() - offset);
+        return QByteArray::fromRawData(reinterpret_cast<const char*>(file.data() + offset),
+                                       static_cast<qsizetype>(length));
+    });
+}
+
+QByteArray ThumbnailStore::hashSamples(qint64 size, const QDateTime& lastModified,
+                                       const std::function<QByteArray(qint64 offset, qint64 length)>& read)
+{
+    QCryptographicHash hash(QCryptographicHash::Sha1);
+    QByteArray meta;
+    QDataStream stream(&meta, QIODevice::WriteOnly);
+    stream << size << lastModified.toMSecsSinceEpoch();
+    hash.addData(meta);
+
+    // Start, middle and end catch both appended incremental updates and
+    // in-place edits without reading the whole file
+    const qint64 samples[] = {0, size / 2 - SAMPLE_SIZE / 2, size - SAMPLE_SIZE};
+    for (qint64 offset : samples) {
+        offset = std::max<qint64>(0, offset);
+        hash.addData(read(offset, SAMPLE_SIZE));
+    }
+
+    return hash.result().toHex();
+}
+
+QString ThumbnailStore::cacheDirectory()
+{
+    return QStandardPaths::writableLocation(QStandardPaths::CacheLocation) + "/thumbnails";
+}
+
+bool ThumbnailStore::readIndex()
+{
+    qint64 indexSize = static_cast<qint64>(m_pageCount) * INDEX_ENTRY_SIZE;
+    if (m_file.size() < HEADER_SIZE + indexSize) {
+        return false;
+    }
+
+    m_file.seek(0);
+    QByteArray header = m_file.read(HEADER_SIZE);
+    const uchar* h = reinterpret_cast<const uchar*>(header.constData());
+    if (header.size() != HEADER_SIZE
+        || qFromLittleEndian<quint32>(h) != MAGIC
+        || qFromLittleEndian<quint32>(h + 4) != VERSION
+        || qFromLittleEndian<quint32>(h + 8) != static_cast<quint32>(m_pageCount)
+        || qFromLittleEndian<quint32>(h + 12) != static_cast<quint32>(m_thumbnailSize.width())
+        || qFromLittleEndian<quint32>(h + 16) != static_cast<quint32>(m_thumbnailSize.height())) {
+        return false;
+    }
+
+    QByteArray index = m_file.read(indexSize);
+    if (index.size() != indexSize) {
+        return false;
+    }
+
+    // Entries pointing outside the file are from a write that never finished
+    qint64 fileSize = m_file.size();
+    m_index.assign(m_pageCount, IndexEntry());
+    for (int i = 0; i < m_pageCount; ++i) {
+        const uchar* e = reinterpret_cast<const uchar*>(index.constData()) + i * INDEX_ENTRY_SIZE;
+        IndexEntry entry;
+        entry.offset = qFromLittleEndian<quint64>(e);
+        entry.length = qFromLittleEndian<quint32>(e + 8);
+        if (entry.offset >= static_cast<quint64>(HEADER_SIZE + indexSize)
+            && static_cast<qint64>(entry.offset + entry.length) <= fileSize) {
+            m_index[i] = entry;
+        }
+    }
+    return true;
+}
+
+bool ThumbnailStore::createFile()
+{
+    QByteArray header(HEADER_SIZE, '\0');
+    uchar* h = reinterpret_cast<uchar*>(header.data());
+    qToLittleEndian<quint32>(MAGIC, h);
+    qToLittleEndian<quint32>(VERSION, h + 4);
+    qToLittleEndian<quint32>(static_cast<quint32>(m_pageCount), h + 8);
+    qToLittleEndian<quint32>(static_cast<quint32>(m_thumbnailSize.width()), h + 12);
+    qToLittleEndian<quint32>(static_cast<quint32>(m_thumbnailSize.height()), h + 16);
+
+    QByteArray index(m_pageCount * INDEX_ENTRY_SIZE, '\0');
+
+    // Written beside the old container and renamed over it rather than
+    // truncated in place: another instance may have the old one mapped,
+    // and shrinking a mapped file faults in that process
+    QSaveFile file(m_file.fileName());
+    if (!file.open(QIODevice::WriteOnly) || file.write(header) != header.size()
+        || file.write(index) != index.size()) {
+        qWarning() << "Failed to create thumbnail cache:" << m_file.fileName();
+        return false;
+    }
+
+    // Our own handle goes first; Windows will not replace an open file
+    if (m_map) {
+        m_file.unmap(m_map);
+        m_map = nullptr;
+        m_mapSize = 0;
+    }
+    m_file.close();
+    if (!file.commit() || !m_file.open(QIODevice::ReadWrite)) {
+        qWarning() << "Failed to create thumbnail cache:" << m_file.fileName();
+        return false;
+    }
+
+    m_index.assign(m_pageCount, IndexEntry());
+    return true;
+}
+
+bool ThumbnailStore::writeIndexEntry(int pageIndex)
+{
+    QByteArray entry(INDEX_ENTRY_SIZE, '\0');
+    uchar* e = reinterpret_cast<uchar*>(entry.data());
+    qToLittleEndian<quint64>(m_index[pageIndex].offset, e);
+    qToLittleEndian<quint32>(m_index[pageIndex].length, e + 8);
+
+    qint64 position = HEADER_SIZE + static_cast<qint64>(pageIndex) * INDEX_ENTRY_SIZE;
+    return m_file.seek(position) && m_file.write(entry) == entry.size();
+}
+
+bool ThumbnailStore::mapUpTo(qint64 end)
+{
+    if (m_map && end <= m_mapSize) {
+        return true;
+    }
+
+    // Thumbnails appended since the file was mapped lie past the mapping
+    if (m_map) {
+        m_file.unmap(m_map);
+        m_map = nullptr;
+        m_mapSize = 0;
+    }
+
+    m_file.flush();
+    qint64 size = m_file.size();
+    if (size < end || size == 0) {
+        return false;
+    }
+
+    m_map = m_file.map(0, size);
+    if (!m_map) {
+        qWarning() << "Cannot map thumbnail cache:" << m_file.fileName();
+        return false;
+    }
+    m_mapSize = size;
+    return true;
+}
+
+void ThumbnailStore::pruneCacheDirectory(qint64 budgetBytes, const QString& keep)
+{
+    QDir dir(cacheDirectory());
+    QFileInfoList files = dir.entryInfoList({"*.thumbs"}, QDir::Files, QDir::Time | QDir::Reversed);
+
+    qint64 total = 0;
+    for (const QFileInfo& info : files) {
+        total += info.size();
+    }
+
+    // Oldest first
+    for (const QFileInfo& info : files) {
+        if (total <= budgetBytes) {
+            break;
+        }
+        if (info.fileName() != keep && QFile::remove(info.filePath())) {
+            total -= info.size();
+        }
+    }
+}
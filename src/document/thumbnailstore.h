@@ -0,0 +1,120 @@
+#pragma once
+
+#include <QByteArray>
+#include <QDateTime>
+#include <QFile>
+#include <QImage>
+#include <QMutex>
+#include <QSize>
+#include <QString>
+#include <functional>
+#include <memory>
+#include <vector>
+
+class MappedFile;
+
+/**
+ * Persistent thumbnail container for one document.
+ *
+ * Every document gets one file under the user cache location, named after a
+ * fingerprint of its contents and the thumbnail size. Editing or replacing
+ * the document changes the fingerprint, so stale thumbnails are never found
+ * again; old containers are pruned once the directory exceeds its budget.
+ *
+ * The file is a fixed header, an index with one slot per page, and the
+ * encoded thumbnails appended after it. It is memory-mapped for reading, so
+ * showing a cached thumbnail is a lookup plus a small image decode.
+ *
+ * Thread-safe: thumbnails are saved from the workers that render them
+ * while the GUI thread reads others. Other viewer instances may use the
+ * same container; a lock file beside it serializes writes, and the file
+ * is only ever replaced by rename, never truncated, so their mappings
+ * stay valid.
+ */
+class ThumbnailStore
+{
+public:
+    ThumbnailStore();
+    ~ThumbnailStore();
+
+    ThumbnailStore(const ThumbnailStore&) = delete;
+    ThumbnailStore& operator=(const ThumbnailStore&) = delete;
+
+    /**
+     * Open or create the container for a document.
+     * @param documentPath Path of the document file
+     * @param pageCount Number of pages in the document
+     * @param thumbnailSize Box the stored thumbnails were fitted into
+     * @param documentFile The reader's mapping of the document, if it has
+     *        one, so fingerprinting reads it rather than the file again
+     * @return true if the container can be used
+     */
+    bool open(const QString& documentPath, int pageCount, const QSize& thumbnailSize,
+              const std::shared_ptr<const MappedFile>& documentFile = nullptr);
+    void close();
+    bool isOpen() const;
+
+    /**
+     * Check for a stored thumbnail without decoding it.
+     */
+    bool contains(int pageIndex) const;
+
+    /**
+     * Decode a stored thumbnail.
+     * @return Thumbnail, or null image if the page has none
+     */
+    QImage load(int pageIndex);
+
+    /**
+     * Encode a thumbnail and append it to the container. Pages that
+     * already have one are left alone. Encoding and writing take a while;
+     * call from a worker thread.
+     */
+    void save(int pageIndex, const QImage& image);
+
+    /**
+     * Fingerprint of a file's contents: its size and modification time
+     * plus a hash of samples from its start, middle and end. Cheap enough
+     * for multi-gigabyte files, and changes whenever the file is rewritten.
+     * @return Hex digest, or empty if the file cannot be read
+     */
+    static QByteArray fingerprint(const QString& filePath);
+    static QByteArray fingerprint(const MappedFile& file);
+
+    /**
+     * Directory holding all thumbnail containers.
+     */
+    static QString cacheDirectory();
+
+private:
+    struct IndexEntry
+    {
+        quint64 offset = 0; // 0 = no thumbnail stored
+        quint32 length = 0;
+    };
+
+    void reset();
+    bool readIndex();
+    bool createFile();
+    bool writeIndexEntry(int pageIndex);
+    bool mapUpTo(qint64 end);
+    static void pruneCacheDirectory(qint64 budgetBytes, const QString& keep);
+    static QByteArray hashSamples(qint64 size, const QDateTime& lastModified,
+                                  const std::function<QByteArray(qint64 offset, qint64 length)>& read);
+
+    mutable QMutex m_mutex; // Guards everything below
+    QFile m_file;
+    uchar* m_map;
+    qint64 m_mapSize;
+    int m_pageCount;
+    QSize m_thumbnailSize;
+    std::vector<IndexEntry> m_index;
+
+    static constexpr quint32 MAGIC = 0x48545244; // "DRTH"
+    static constexpr quint32 VERSION = 2; // 2: rendered at the target size, not scaled down
+    static constexpr int HEADER_SIZE = 32;
+    static constexpr int INDEX_ENTRY_SIZE = 16;
+    static constexpr qint64 SAMPLE_SIZE = 64 * 1024;
+    static constexpr int JPEG_QUALITY = 85;
+    static constexpr int LOCK_TIMEOUT_MS = 1000;
+};
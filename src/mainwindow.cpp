@@ -3,6 +3,8 @@
 #include "widgets/thumbnailwidget.h"
 #include "document/documentfactory.h"
 #include "document/documentreader.h"
+#include "document/searchsession.h"
+#include "config.h"
 
 #include <QApplication>
 #include <QAction>
@@ -13,6 +15,7 @@
 #include <QFileDialog>
 #include <QMessageBox>
 #include <QInputDialog>
+#include <QLineEdit>
 #include <QDockWidget>
 #include <QVBoxLayout>
 #include <QHBoxLayout>
@@ -21,6 +24,10 @@
 #include <QLabel>
 #include <QStandardPaths>
 #include <QSettings>
+#include <QPointer>
+#include <QRunnable>
+#include <QThreadPool>
+#include <QTimer>
 
 MainWindow::MainWindow(QWidget *parent)
     : QMainWindow(parent)
@@ -30,6 +37,9 @@ MainWindow::MainWindow(QWidget *parent)
     , m_pageLabel(nullptr)
     , m_zoomLabel(nullptr)
     , m_progressBar(nullptr)
+    , m_loadGeneration(std::make_shared<std::atomic<quint64>>(0))
+    , m_thumbnailsPending(false)
+    , m_searchSession(nullptr)
 {
     setWindowTitle("Document Reader");
     setMinimumSize(800, 600);
@@ -39,6 +49,15 @@ MainWindow::MainWindow(QWidget *parent)
     m_documentViewer = new DocumentViewer(this);
     setCentralWidget(m_documentViewer);
     
+    m_searchSession = new SearchSession(this);
+    connect(m_searchSession, &SearchSession::pageMatched, this, &MainWindow::onSearchMatched);
+    connect(m_searchSession, &SearchSession::finished, this, &MainWindow::onSearchFinished);
+    
+    // Render cache budget can be tuned for very large documents
+    QSettings settings;
+    qint64 cacheMB = settings.value("renderCache/budgetMB", DEFAULT_RENDER_CACHE_MB).toLongLong();
+    m_documentViewer->setRenderCacheBudget(cacheMB * 1024 * 1024);
+    
     createActions();
     createMenus();
     createToolBars();
@@ -50,9 +69,22 @@ MainWindow::MainWindow(QWidget *parent)
     // Connect document viewer signals
     connect(m_documentViewer, &DocumentViewer::pageChanged, this, &MainWindow::updateStatusBar);
     connect(m_documentViewer, &DocumentViewer::zoomChanged, this, &MainWindow::updateStatusBar);
+    
+    // Thumbnails would compete with the first page for the document; they
+    // start once it is on screen
+    connect(m_documentViewer, &DocumentViewer::pageRendered, this, &MainWindow::attachPendingThumbnails);
 }
 
-MainWindow::~MainWindow() = default;
+MainWindow::~MainWindow()
+{
+    // Child widgets outlive m_document; detach them so no background
+    // render or search is still using the reader when it is destroyed.
+    // A load still running finishes on its own and frees its reader there.
+    ++*m_loadGeneration;
+    stopSearch();
+    m_documentViewer->setDocument(nullptr);
+    m_thumbnailWidget->setDocument(nullptr);
+}
 
 void MainWindow::createActions()
 {
@@ -80,6 +112,22 @@ void MainWindow::createActions()
     m_exitAction->setStatusTip("Exit the application");
     connect(m_exitAction, &QAction::triggered, this, &QWidget::close);
     
+    // Edit actions
+    m_findAction = new QAction("&Find...", this);
+    m_findAction->setShortcut(QKeySequence::Find);
+    m_findAction->setStatusTip("Search the document for text");
+    connect(m_findAction, &QAction::triggered, this, &MainWindow::find);
+    
+    m_findNextAction = new QAction("Find &Next", this);
+    m_findNextAction->setShortcut(QKeySequence::FindNext);
+    m_findNextAction->setStatusTip("Go to the next search hit");
+    connect(m_findNextAction, &QAction::triggered, m_documentViewer, &DocumentViewer::findNext);
+    
+    m_findPreviousAction = new QAction("Find Pre&vious", this);
+    m_findPreviousAction->setShortcut(QKeySequence::FindPrevious);
+    m_findPreviousAction->setStatusTip("Go to the previous search hit");
+    connect(m_findPreviousAction, &QAction::triggered, m_documentViewer, &DocumentViewer::findPrevious);
+    
     // View actions
     m_zoomInAction = new QAction("Zoom &In", this);
     m_zoomInAction->setShortcut(QKeySequence::ZoomIn);
@@ -107,6 +155,11 @@ void MainWindow::createActions()
     m_actualSizeAction->setStatusTip("Show document at actual size");
     connect(m_actualSizeAction, &QAction::triggered, this, &MainWindow::actualSize);
     
+    m_continuousScrollAction = new QAction("&Continuous Scroll", this);
+    m_continuousScrollAction->setStatusTip("Show all pages in one scrollable strip");
+    m_continuousScrollAction->setCheckable(true);
+    connect(m_continuousScrollAction, &QAction::toggled, m_documentViewer, &DocumentViewer::setContinuousScroll);
+    
     // Navigation actions
     m_goToPageAction = new QAction("&Go to Page...", this);
     m_goToPageAction->setShortcut(Qt::CTRL | Qt::Key_G);
@@ -156,6 +209,11 @@ void MainWindow::createMenus()
     m_fileMenu->addSeparator();
     m_fileMenu->addAction(m_exitAction);
     
+    m_editMenu = menuBar()->addMenu("&Edit");
+    m_editMenu->addAction(m_findAction);
+    m_editMenu->addAction(m_findNextAction);
+    m_editMenu->addAction(m_findPreviousAction);
+    
     m_viewMenu = menuBar()->addMenu("&View");
     m_viewMenu->addAction(m_zoomInAction);
     m_viewMenu->addAction(m_zoomOutAction);
@@ -164,6 +222,8 @@ void MainWindow::createMenus()
     m_viewMenu->addAction(m_fitToPageAction);
     m_viewMenu->addAction(m_actualSizeAction);
     m_viewMenu->addSeparator();
+    m_viewMenu->addAction(m_continuousScrollAction);
+    m_viewMenu->addSeparator();
     m_viewMenu->addAction(m_goToPageAction);
     m_viewMenu->addAction(m_nextPageAction);
     m_viewMenu->addAction(m_previousPageAction);
@@ -213,6 +273,11 @@ void MainWindow::createDockWidgets()
     // Connect thumbnail widget
     connect(m_thumbnailWidget, &ThumbnailWidget::pageRequested, 
             m_documentViewer, &DocumentViewer::goToPage);
+    
+    // Thumbnails double as instant stand-ins while a page renders
+    m_documentViewer->setPreviewProvider([this](int pageIndex) {
+        return m_thumbnailWidget->thumbnail(pageIndex);
+    });
 }
 
 void MainWindow::openDocument()
@@ -225,36 +290,117 @@ void MainWindow::openDocument()
     if (fileName.isEmpty())
         return;
     
-    m_progressBar->setVisible(true);
-    m_progressBar->setRange(0, 0); // Indeterminate progress
+    openDocumentFile(fileName);
+}
+
+void MainWindow::openDocumentFile(const QString& fileName)
+{
+    std::unique_ptr<DocumentReader> document = DocumentFactory::createReader(fileName);
+    if (!document) {
+        QMessageBox::warning(this, "Error", "Unsupported document format");
+        return;
+    }
     
-    try {
-        m_document = DocumentFactory::createReader(fileName);
-        if (m_document && m_document->load(fileName)) {
-            m_currentFile = fileName;
-            m_documentViewer->setDocument(m_document.get());
-            m_thumbnailWidget->setDocument(m_document.get());
-            setWindowTitle(QString("Document Reader - %1").arg(QFileInfo(fileName).fileName()));
-            updateActions();
-            updateStatusBar();
-            
-            // Add to recent files
-            addToRecentFiles(fileName);
-        } else {
-            QMessageBox::warning(this, "Error", "Failed to load document");
+    // Parsing a large file, especially from a network share, can take a
+    // long time; do it off the GUI thread and keep the current document
+    // usable meanwhile
+    quint64 generation = ++*m_loadGeneration;
+    m_progressBar->setRange(0, 0); // Indeterminate progress
+    m_progressBar->setVisible(true);
+    statusBar()->showMessage(QString("Opening %1...").arg(QFileInfo(fileName).fileName()));
+    
+    // Shared so the reader is freed wherever the load ends up being dropped
+    auto loading = std::make_shared<std::unique_ptr<DocumentReader>>(std::move(document));
+    std::shared_ptr<std::atomic<quint64>> currentGeneration = m_loadGeneration;
+    QPointer<MainWindow> window(this);
+    QThreadPool::globalInstance()->start(QRunnable::create([window, currentGeneration, loading, fileName, generation]() {
+        bool loaded = false;
+        QString error;
+        try {
+            loaded = (*loading)->load(fileName);
+        } catch (const std::exception& e) {
+            error = QString::fromLocal8Bit(e.what());
         }
-    } catch (const std::exception& e) {
-        QMessageBox::critical(this, "Error", QString("Failed to load document: %1").arg(e.what()));
+        
+        if (generation != *currentGeneration) {
+            return; // Superseded; closed here rather than on the GUI thread
+        }
+        
+        // Delivered through the application object, which outlives the
+        // window; whether the window still exists is only known on its
+        // own thread
+        QMetaObject::invokeMethod(QCoreApplication::instance(), [window, loading, fileName, generation, loaded, error]() {
+            if (window && generation == *window->m_loadGeneration) {
+                window->onDocumentLoaded(std::move(*loading), fileName, loaded, error);
+            }
+        }, Qt::QueuedConnection);
+    }));
+}
+
+void MainWindow::onDocumentLoaded(std::unique_ptr<DocumentReader> document, const QString& fileName,
+                                  bool loaded, const QString& error)
+{
+    m_progressBar->setVisible(false);
+    statusBar()->clearMessage();
+    
+    if (!error.isEmpty()) {
+        QMessageBox::critical(this, "Error", QString("Failed to load document: %1").arg(error));
+        return;
+    }
+    if (!loaded) {
+        QMessageBox::warning(this, "Error", "Failed to load document");
+        return;
     }
     
-    m_progressBar->setVisible(false);
+    // Views stop their background work on the old document before it is
+    // released. The viewer starts on page 1 right away; the page count
+    // and metadata are known from here on, the rest fills in as the
+    // reader's background threads get to it.
+    stopSearch();
+    m_thumbnailWidget->setDocument(nullptr);
+    m_documentViewer->setDocument(document.get());
+    m_document = std::move(document);
+    m_currentFile = fileName;
+    m_thumbnailsPending = true;
+    
+    // Also when the first page takes long, or is only ever shown in tiles
+    QTimer::singleShot(THUMBNAIL_START_DELAY_MS, this, [this, generation = m_loadGeneration->load()]() {
+        if (generation == *m_loadGeneration) {
+            attachPendingThumbnails();
+        }
+    });
+    
+    QString title = m_document->title().trimmed();
+    setWindowTitle(title.isEmpty()
+        ? QString("Document Reader - %1").arg(QFileInfo(fileName).fileName())
+        : QString("Document Reader - %1 - %2").arg(QFileInfo(fileName).fileName(), title));
+    updateActions();
+    updateStatusBar();
+    
+    // Add to recent files
+    addToRecentFiles(fileName);
+}
+
+void MainWindow::attachPendingThumbnails()
+{
+    if (m_thumbnailsPending) {
+        m_thumbnailsPending = false;
+        m_thumbnailWidget->setDocument(m_document.get());
+    }
 }
 
 void MainWindow::closeDocument()
 {
-    m_document.reset();
+    // Also drops a document that is still being opened
+    ++*m_loadGeneration;
+    m_progressBar->setVisible(false);
+    statusBar()->clearMessage();
+    m_thumbnailsPending = false;
+    
+    stopSearch();
     m_documentViewer->setDocument(nullptr);
     m_thumbnailWidget->setDocument(nullptr);
+    m_document.reset();
     m_currentFile.clear();
     setWindowTitle("Document Reader");
     updateActions();
@@ -318,6 +464,51 @@ void MainWindow::previousPage()
     m_documentViewer->previousPage();
 }
 
+void MainWindow::find()
+{
+    if (!m_document)
+        return;
+    
+    bool ok;
+    QString text = QInputDialog::getText(this, "Find", "Find text:", QLineEdit::Normal,
+                                         m_searchSession->text(), &ok);
+    if (!ok || text.isEmpty())
+        return;
+    
+    m_documentViewer->clearSearchHits();
+    m_searchSession->start(m_document.get(), text, false, m_documentViewer->currentPage());
+    statusBar()->showMessage(QString("Searching for \"%1\"...").arg(text));
+}
+
+void MainWindow::onSearchMatched(int pageIndex, const QList<QRectF>& hits)
+{
+    bool first = m_documentViewer->searchHitCount() == 0;
+    m_documentViewer->addSearchHits(pageIndex, hits);
+    
+    // Hits arrive nearest first; jump to the first one right away
+    if (first) {
+        m_documentViewer->findNext();
+    }
+}
+
+void MainWindow::onSearchFinished(int matchedPages)
+{
+    if (matchedPages == 0) {
+        statusBar()->showMessage(QString("\"%1\" not found").arg(m_searchSession->text()), 5000);
+        return;
+    }
+    statusBar()->showMessage(QString("%1 matches on %2 pages")
+        .arg(m_documentViewer->searchHitCount())
+        .arg(matchedPages), 5000);
+}
+
+void MainWindow::stopSearch()
+{
+    m_searchSession->cancel();
+    m_searchSession->waitForDone();
+    m_documentViewer->clearSearchHits();
+}
+
 void MainWindow::showAbout()
 {
     QMessageBox::about(this, "About Document Reader",
@@ -341,6 +532,33 @@ void MainWindow::updateActions()
     m_goToPageAction->setEnabled(hasDocument);
     m_nextPageAction->setEnabled(hasDocument);
     m_previousPageAction->setEnabled(hasDocument);
+    m_findAction->setEnabled(hasDocument);
+    m_findNextAction->setEnabled(hasDocument);
+    m_findPreviousAction->setEnabled(hasDocument);
+}
+
+void MainWindow::updateStatusBar()
+{
+    if (!m_document) {
+        m_pageLabel->setText("No document");
+        m_pageLabel->setToolTip(QString());
+        m_zoomLabel->setText("100%");
+        return;
+    }
+    
+    m_pageLabel->setText(QString("Page %1 of %2")
+        .arg(m_documentViewer->currentPage() + 1)
+        .arg(m_document->pageCount()));
+    m_zoomLabel->setText(QString("%1%").arg(qRound(m_documentViewer->zoomFactor() * 100)));
+    
+    RenderCache::Stats stats = m_documentViewer->renderCacheStats();
+    m_pageLabel->setToolTip(QString("Render cache: %1 hits, %2 misses (%3% hit rate), %4 pages, %5 / %6 MB")
+        .arg(stats.hits)
+        .arg(stats.misses)
+        .arg(qRound(stats.hitRate() * 100))
+        .arg(stats.entries)
+        .arg(stats.bytes / (1024 * 1024))
+        .arg(stats.budget / (1024 * 1024)));
 }
 
 // Recent files implementation
@@ -16,6 +16,9 @@
 #include <QDockWidget>
 #include <QSettings>
 #include <QStringList>
+#include <QList>
+#include <QRectF>
+#include <atomic>
 #include <memory>
 
 QT_BEGIN_NAMESPACE
@@ -26,6 +29,7 @@ QT_END_NAMESPACE
 class DocumentViewer;
 class ThumbnailWidget;
 class DocumentReader;
+class SearchSession;
 
 class MainWindow : public QMainWindow
 {
@@ -47,6 +51,9 @@ private slots:
     void goToPage();
     void nextPage();
     void previousPage();
+    void find();
+    void onSearchMatched(int pageIndex, const QList<QRectF>& hits);
+    void onSearchFinished(int matchedPages);
     void showAbout();
     
     // Recent files
@@ -61,6 +68,12 @@ private:
     void createDockWidgets();
     void updateActions();
     void updateStatusBar();
+    void stopSearch();
+    
+    // Opening documents
+    void openDocumentFile(const QString& fileName);
+    void onDocumentLoaded(std::unique_ptr<DocumentReader> document, const QString& fileName,
+                          bool loaded, const QString& error);
 
     // Central widget
     DocumentViewer* m_documentViewer;
@@ -71,6 +84,7 @@ private:
     
     // Menus
     QMenu* m_fileMenu;
+    QMenu* m_editMenu;
     QMenu* m_viewMenu;
     QMenu* m_helpMenu;
     
@@ -80,11 +94,16 @@ private:
     QAction* m_printAction;
     QAction* m_exitAction;
     
+    QAction* m_findAction;
+    QAction* m_findNextAction;
+    QAction* m_findPreviousAction;
+    
     QAction* m_zoomInAction;
     QAction* m_zoomOutAction;
     QAction* m_fitToWidthAction;
     QAction* m_fitToPageAction;
     QAction* m_actualSizeAction;
+    QAction* m_continuousScrollAction;
     
     QAction* m_goToPageAction;
     QAction* m_nextPageAction;
@@ -109,6 +128,17 @@ private:
     // Document
     std::unique_ptr<DocumentReader> m_document;
     QString m_currentFile;
+    
+    // Documents are parsed on the global thread pool; a load whose
+    // generation is no longer current has been superseded or cancelled and
+    // is dropped. Loads share the counter so they can still tell once the
+    // window is gone; nothing ever waits for them.
+    std::shared_ptr<std::atomic<quint64>> m_loadGeneration;
+    bool m_thumbnailsPending; // Attached once the first page is up
+    void attachPendingThumbnails();
+    
+    // Search
+    SearchSession* m_searchSession;
 
     // Recent files
     QStringList m_recentFiles;
@@ -0,0 +1,91 @@
+#pragma once
+
+#include <QMutex>
+#include <QMutexLocker>
+#include <QWaitCondition>
+#include <deque>
+#include <optional>
+#include <utility>
+
+/**
+ * Queue between threads that holds at most a fixed number of items.
+ *
+ * push() blocks while the queue is full, so a fast producer is held back to
+ * the pace of its consumers and the memory held by queued items stays
+ * bounded. Once close() is called no more items are accepted; consumers
+ * drain what is left and then pop() returns nothing.
+ *
+ * Thread-safe.
+ */
+template <typename T>
+class BoundedQueue
+{
+public:
+    explicit BoundedQueue(qsizetype capacity)
+        : m_capacity(capacity > 0 ? capacity : 1)
+        , m_closed(false)
+    {
+    }
+
+    BoundedQueue(const BoundedQueue&) = delete;
+    BoundedQueue& operator=(const BoundedQueue&) = delete;
+
+    /**
+     * Add an item, waiting while the queue is full.
+     * @return false if the queue was closed and the item dropped
+     */
+    bool push(T item)
+    {
+        QMutexLocker locker(&m_mutex);
+        while (!m_closed && static_cast<qsizetype>(m_items.size()) >= m_capacity) {
+            m_notFull.wait(&m_mutex);
+        }
+        if (m_closed) {
+            return false;
+        }
+
+        m_items.push_back(std::move(item));
+        m_notEmpty.wakeOne();
+        return true;
+    }
+
+    /**
+     * Take the oldest item, waiting while the queue is empty.
+     * @return The item, or nothing once the queue is closed and drained
+     */
+    std::optional<T> pop()
+    {
+        QMutexLocker locker(&m_mutex);
+        while (!m_closed && m_items.empty()) {
+            m_notEmpty.wait(&m_mutex);
+        }
+        if (m_items.empty()) {
+            return std::nullopt;
+        }
+
+        T item = std::move(m_items.front());
+        m_items.pop_front();
+        m_notFull.wakeOne();
+        return item;
+    }
+
+    /**
+     * Stop accepting items and wake every waiting thread. Items already
+     * queued can still be popped.
+     */
+    void close()
+    {
+        QMutexLocker locker(&m_mutex);
+        m_closed = true;
+        m_notEmpty.wakeAll();
+        m_notFull.wakeAll();
+    }
+
+private:
+    QMutex m_mutex;
+    QWaitCondition m_notEmpty;
+    QWaitCondition m_notFull;
+    std::deque<T> m_items;
+    const qsizetype m_capacity;
+    bool m_closed;
+};
@@ -0,0 +1,320 @@
+// docreader-render: renders document pages to image files without a display.
+//
+// The main thread opens the documents one after another and queues their
+// pages; render threads turn pages into images and encode threads write
+// them out. Both queues are bounded, so memory stays flat however many
+// pages are asked for, and each stage runs while the others are busy.
+// Readers render from several threads at once through their own pools of
+// document handles, so a document is opened once and its pages spread
+// over every render thread.
+
+#include "document/documentfactory.h"
+#include "document/documentreader.h"
+#include "boundedqueue.h"
+#include "pageranges.h"
+#include <QCommandLineParser>
+#include <QDir>
+#include <QElapsedTimer>
+#include <QFileInfo>
+#include <QGuiApplication>
+#include <QHash>
+#include <QImage>
+#include <QImageWriter>
+#include <QPainter>
+#include <QSet>
+#include <QTextStream>
+#include <QThread>
+#include <atomic>
+#include <memory>
+#include <optional>
+#include <vector>
+
+namespace {
+
+constexpr double DEFAULT_DPI = 150.0;
+
+enum ExitCode {
+    ExitOk = 0,
+    ExitFailures = 1,
+    ExitUsage = 2
+};
+
+struct RenderJob {
+    std::shared_ptr<const DocumentReader> document;
+    int pageIndex;
+    QString outputPath;
+};
+
+struct EncodeJob {
+    QImage image;
+    QString outputPath;
+};
+
+struct Options {
+    QDir outputDir;
+    QByteArray format;
+    double dpi = DEFAULT_DPI;
+    QSize box;
+    int quality = -1;
+    int jobs = 1;
+    PageRanges pages;
+};
+
+bool parseSize(const QString& text, QSize* size)
+{
+    QStringList parts = text.split(u'x');
+    if (parts.size() != 2) {
+        return false;
+    }
+    bool widthOk = false;
+    bool heightOk = false;
+    *size = QSize(parts[0].toInt(&widthOk), parts[1].toInt(&heightOk));
+    return widthOk && heightOk && !size->isEmpty();
+}
+
+// Name the images of each file start with. Files of the same name, such as
+// a/report.pdf and b/report.pdf, are told apart by their directory and,
+// failing that, by a number, so none overwrites the pages of another.
+// Names are compared ignoring case for case-insensitive file systems.
+QStringList outputNames(const QStringList& files)
+{
+    QHash<QString, int> baseNames;
+    for (const QString& filePath : files) {
+        ++baseNames[QFileInfo(filePath).completeBaseName().toCaseFolded()];
+    }
+
+    QStringList names;
+    QSet<QString> used;
+    for (const QString& filePath : files) {
+        QFileInfo info(filePath);
+        QString name = info.completeBaseName();
+        if (baseNames.value(name.toCaseFolded()) > 1) {
+            name = info.absoluteDir().dirName() + u'_' + name;
+        }
+        QString unique = name;
+        for (int n = 2; used.contains(unique.toCaseFolded()); ++n) {
+            unique = QStringLiteral("%1_%2").arg(name).arg(n);
+        }
+        used.insert(unique.toCaseFolded());
+        names.append(unique);
+    }
+    return names;
+}
+
+QString outputPath(const Options& options, const QString& outputName, int pageIndex, int pageCount)
+{
+    int width = static_cast<int>(QString::number(pageCount).size());
+    QString name = QStringLiteral("%1-%2.%3")
+                       .arg(outputName)
+                       .arg(pageIndex + 1, width, 10, QLatin1Char('0'))
+                       .arg(QString::fromLatin1(options.format));
+    return options.outputDir.filePath(name);
+}
+
+bool formatHasAlpha(const QByteArray& format)
+{
+    return format != "jpg" && format != "jpeg";
+}
+
+// Lays an image with transparency over white, as the page would be viewed,
+// instead of letting the encoder turn transparent areas black
+QImage flattened(const QImage& image)
+{
+    QImage result(image.size(), QImage::Format_RGB32);
+    result.setDevicePixelRatio(image.devicePixelRatio());
+    result.fill(Qt::white);
+    QPainter painter(&result);
+    painter.drawImage(0, 0, image);
+    return result;
+}
+
+} // namespace
+
+int main(int argc, char* argv[])
+{
+    // Rendering needs no display; fall back to the offscreen platform so
+    // the tool runs on servers unless a platform was asked for
+    if (!qEnvironmentVariableIsSet("QT_QPA_PLATFORM")) {
+        qputenv("QT_QPA_PLATFORM", "offscreen");
+    }
+
+    QGuiApplication app(argc, argv);
+    app.setApplicationName("docreader-render");
+    app.setApplicationVersion("1.0.0");
+    app.setOrganizationName("DocumentReader");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription("Render document pages to image files.");
+    parser.addHelpOption();
+    parser.addVersionOption();
+    parser.addPositionalArgument("files", "Documents to render.", "files...");
+
+    QCommandLineOption outputOption({"o", "output"}, "Directory to write images to.", "dir", ".");
+    QCommandLineOption formatOption({"f", "format"}, "Image format: png, jpg or webp.", "format", "png");
+    QCommandLineOption dpiOption({"d", "dpi"}, "Resolution to render at.", "dpi",
+                                 QString::number(DEFAULT_DPI));
+    QCommandLineOption sizeOption({"s", "size"}, "Fit each page into WxH pixels instead of using a DPI.",
+                                  "WxH");
+    QCommandLineOption pagesOption({"p", "pages"}, "Pages to render from every file, such as 1-3,7,10-.",
+                                   "ranges");
+    QCommandLineOption qualityOption({"q", "quality"}, "Encoder quality from 0 to 100.", "quality");
+    QCommandLineOption jobsOption({"j", "jobs"}, "Number of render threads.", "count",
+                                  QString::number(QThread::idealThreadCount()));
+    parser.addOptions({outputOption, formatOption, dpiOption, sizeOption, pagesOption, qualityOption, jobsOption});
+    parser.process(app);
+
+    QTextStream err(stderr);
+    auto usageError = [&err](const QString& message) {
+        err << "docreader-render: " << message << Qt::endl;
+        return ExitUsage;
+    };
+
+    const QStringList files = parser.positionalArguments();
+    if (files.isEmpty()) {
+        parser.showHelp(ExitUsage);
+    }
+
+    Options options;
+
+    options.format = parser.value(formatOption).toLower().toLatin1();
+    if (!QImageWriter::supportedImageFormats().contains(options.format)) {
+        return usageError(QStringLiteral("Image format not available: %1").arg(parser.value(formatOption)));
+    }
+
+    bool ok = true;
+    options.dpi = parser.value(dpiOption).toDouble(&ok);
+    if (!ok || options.dpi <= 0) {
+        return usageError(QStringLiteral("Invalid DPI: %1").arg(parser.value(dpiOption)));
+    }
+    if (parser.isSet(sizeOption) && !parseSize(parser.value(sizeOption), &options.box)) {
+        return usageError(QStringLiteral("Invalid size: %1").arg(parser.value(sizeOption)));
+    }
+    if (parser.isSet(pagesOption) && !options.pages.parse(parser.value(pagesOption))) {
+        return usageError(QStringLiteral("Invalid page ranges: %1").arg(parser.value(pagesOption)));
+    }
+    if (parser.isSet(qualityOption)) {
+        options.quality = parser.value(qualityOption).toInt(&ok);
+        if (!ok || options.quality < 0 || options.quality > 100) {
+            return usageError(QStringLiteral("Invalid quality: %1").arg(parser.value(qualityOption)));
+        }
+    }
+    options.jobs = parser.value(jobsOption).toInt(&ok);
+    if (!ok || options.jobs < 1) {
+        return usageError(QStringLiteral("Invalid number of jobs: %1").arg(parser.value(jobsOption)));
+    }
+
+    options.outputDir = QDir(parser.value(outputOption));
+    if (!options.outputDir.mkpath(".")) {
+        return usageError(QStringLiteral("Cannot create output directory: %1").arg(parser.value(outputOption)));
+    }
+
+    // A couple of items per thread keeps every stage fed without holding
+    // more than a few pages' worth of pixels
+    BoundedQueue<RenderJob> renderQueue(2 * options.jobs);
+    BoundedQueue<EncodeJob> encodeQueue(2 * options.jobs);
+    std::atomic_int rendered(0);
+    std::atomic_int failed(0);
+
+    std::vector<std::unique_ptr<QThread>> renderThreads;
+    for (int i = 0; i < options.jobs; ++i) {
+        renderThreads.emplace_back(QThread::create([&options, &renderQueue, &encodeQueue, &failed]() {
+            while (std::optional<RenderJob> job = renderQueue.pop()) {
+                QImage image = options.box.isValid()
+                    ? job->document->renderThumbnail(job->pageIndex, options.box)
+                    : job->document->renderImage(job->pageIndex, options.dpi);
+                if (image.isNull()) {
+                    qWarning().noquote() << "Failed to render page" << job->pageIndex + 1
+                                         << "of" << job->document->filePath();
+                    ++failed;
+                    continue;
+                }
+                encodeQueue.push({std::move(image), std::move(job->outputPath)});
+                // The last job of a document closes it here
+            }
+        }));
+    }
+
+    // Encoding is about as costly as rendering, so it gets as many threads
+    std::vector<std::unique_ptr<QThread>> encodeThreads;
+    for (int i = 0; i < options.jobs; ++i) {
+        encodeThreads.emplace_back(QThread::create([&options, &encodeQueue, &rendered, &failed]() {
+            while (std::optional<EncodeJob> job = encodeQueue.pop()) {
+                QImageWriter writer(job->outputPath, options.format);
+                if (options.quality >= 0) {
+                    writer.setQuality(options.quality);
+                }
+                bool written = !formatHasAlpha(options.format) && job->image.hasAlphaChannel()
+                    ? writer.write(flattened(job->image))
+                    : writer.write(job->image);
+                if (!written) {
+                    qWarning().noquote() << "Failed to write" << job->outputPath << "-" << writer.errorString();
+                    ++failed;
+                    continue;
+                }
+                ++rendered;
+            }
+        }));
+    }
+
+    for (const auto& thread : renderThreads) {
+        thread->start();
+    }
+    for (const auto& thread : encodeThreads) {
+        thread->start();
+    }
+
+    QElapsedTimer timer;
+    timer.start();
+
+    const QStringList names = outputNames(files);
+    for (qsizetype i = 0; i < files.size(); ++i) {
+        const QString& filePath = files[i];
+        if (names[i] != QFileInfo(filePath).completeBaseName()) {
+            qWarning().noquote() << "Pages of" << filePath << "are written as" << names[i] + "-*";
+        }
+
+        std::unique_ptr<DocumentReader> reader = DocumentFactory::createReader(filePath);
+        if (!reader) {
+            qWarning().noquote() << "Unsupported format:" << filePath;
+            ++failed;
+            continue;
+        }
+
+        // Only a few pages are visited, once each; indexing the whole
+        // document or measuring every page would be wasted
+        reader->setBackgroundWork(false);
+        if (!reader->load(filePath)) {
+            qWarning().noquote() << "Failed to open" << filePath;
+            ++failed;
+            continue;
+        }
+
+        std::shared_ptr<const DocumentReader> document(std::move(reader));
+        int pageCount = document->pageCount();
+        for (int pageIndex : options.pages.pages(pageCount)) {
+            renderQueue.push({document, pageIndex, outputPath(options, names[i], pageIndex, pageCount)});
+        }
+    }
+
+    renderQueue.close();
+    for (const auto& thread : renderThreads) {
+        thread->wait();
+    }
+    encodeQueue.close();
+    for (const auto& thread : encodeThreads) {
+        thread->wait();
+    }
+
+    double seconds = timer.elapsed() / 1000.0;
+    QTextStream out(stdout);
+    out << QStringLiteral("Rendered %1 pages in %2 s (%3 pages/s)")
+               .arg(rendered.load())
+               .arg(seconds, 0, 'f', 2)
+               .arg(seconds > 0 ? rendered.load() / seconds : 0.0, 0, 'f', 1)
+        << Qt::endl;
+    if (failed > 0) {
+        err << failed.load() << " failed" << Qt::endl;
+        return ExitFailures;
+    }
+    return ExitOk;
+}
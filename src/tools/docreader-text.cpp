@@ -0,0 +1,286 @@
+// docreader-text: extracts the text of documents as JSON Lines.
+//
+// Every page becomes one line of JSON, written in the order of the files and
+// their pages however the work is spread. The main thread opens documents
+// and queues their pages, worker threads extract them and a writer thread
+// puts the lines out in order. Each queued page holds a slot in the output
+// queue, which is bounded, so only a fixed number of pages is ever in flight
+// and memory stays flat whatever the size or number of documents.
+
+#include "document/documentfactory.h"
+#include "document/documentreader.h"
+#include "boundedqueue.h"
+#include "pageranges.h"
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QElapsedTimer>
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QTextStream>
+#include <QThread>
+#include <atomic>
+#include <cmath>
+#include <cstdio>
+#include <future>
+#include <memory>
+#include <optional>
+#include <vector>
+
+namespace {
+
+enum ExitCode {
+    ExitOk = 0,
+    ExitFailures = 1,
+    ExitUsage = 2
+};
+
+struct ExtractJob {
+    std::shared_ptr<const DocumentReader> document;
+    int pageIndex;
+    std::promise<QByteArray> line;
+};
+
+// Two decimals are far finer than any glyph and keep the lines short
+double rounded(double points)
+{
+    return std::round(points * 100.0) / 100.0;
+}
+
+QByteArray jsonLine(const QJsonObject& object)
+{
+    return QJsonDocument(object).toJson(QJsonDocument::Compact) + '\n';
+}
+
+QByteArray errorLine(const QString& filePath, const QString& message)
+{
+    return jsonLine(QJsonObject{{"file", filePath}, {"error", message}});
+}
+
+QByteArray pageLine(const DocumentReader& document, int pageIndex, bool withWords)
+{
+    // Text first: readers note the size of every page they parse, so the
+    // size then comes without opening the page a second time
+    QString text = document.extractText(pageIndex);
+    QSizeF size = document.pageSize(pageIndex);
+    QJsonObject object{
+        {"file", document.filePath()},
+        {"page", pageIndex + 1},
+        {"width", rounded(size.width())},
+        {"height", rounded(size.height())},
+        {"text", text}
+    };
+
+    if (withWords) {
+        QJsonArray words;
+        for (const DocumentReader::Word& word : document.extractWords(pageIndex)) {
+            QJsonArray box{rounded(word.rect.x()), rounded(word.rect.y()),
+                           rounded(word.rect.width()), rounded(word.rect.height())};
+            QJsonObject entry{{"text", word.text}, {"box", box}};
+            if (word.spaceAfter) {
+                entry.insert("space", true);
+            }
+            words.append(entry);
+        }
+        object.insert("words", words);
+    }
+
+    return jsonLine(object);
+}
+
+} // namespace
+
+int main(int argc, char* argv[])
+{
+    // Text needs no windowing system, so a core application will do
+    QCoreApplication app(argc, argv);
+    app.setApplicationName("docreader-text");
+    app.setApplicationVersion("1.0.0");
+    app.setOrganizationName("DocumentReader");
+
+    QCommandLineParser parser;
+    parser.setApplicationDescription(
+        "Extract the text of documents as JSON Lines, one line per page:\n"
+        "{\"file\", \"page\", \"width\", \"height\", \"text\"[, \"words\"]}\n"
+        "Sizes and word boxes [x, y, width, height] are in points from the top left.");
+    parser.addHelpOption();
+    parser.addVersionOption();
+    parser.addPositionalArgument("files", "Documents to extract.", "files...");
+
+    QCommandLineOption outputOption({"o", "output"}, "File to write to instead of standard output.", "file");
+    QCommandLineOption filesFromOption("files-from", "Read more documents from a file, one per line; - for standard input.",
+                                       "file");
+    QCommandLineOption wordsOption({"w", "words"}, "Include every word with its bounding box.");
+    QCommandLineOption pagesOption({"p", "pages"}, "Pages to extract from every file, such as 1-3,7,10-.",
+                                   "ranges");
+    QCommandLineOption jobsOption({"j", "jobs"}, "Number of extraction threads.", "count",
+                                  QString::number(QThread::idealThreadCount()));
+    parser.addOptions({outputOption, filesFromOption, wordsOption, pagesOption, jobsOption});
+    parser.process(app);
+
+    QTextStream err(stderr);
+    auto usageError = [&err](const QString& message) {
+        err << "docreader-text: " << message << Qt::endl;
+        return ExitUsage;
+    };
+
+    const QStringList files = parser.positionalArguments();
+    if (files.isEmpty() && !parser.isSet(filesFromOption)) {
+        parser.showHelp(ExitUsage);
+    }
+
+    PageRanges pages;
+    if (parser.isSet(pagesOption) && !pages.parse(parser.value(pagesOption))) {
+        return usageError(QStringLiteral("Invalid page ranges: %1").arg(parser.value(pagesOption)));
+    }
+
+    bool ok = true;
+    int jobs = parser.value(jobsOption).toInt(&ok);
+    if (!ok || jobs < 1) {
+        return usageError(QStringLiteral("Invalid number of jobs: %1").arg(parser.value(jobsOption)));
+    }
+    bool withWords = parser.isSet(wordsOption);
+
+    QFile fileList;
+    if (parser.isSet(filesFromOption)) {
+        QString path = parser.value(filesFromOption);
+        bool opened = false;
+        if (path == "-") {
+            opened = fileList.open(stdin, QIODevice::ReadOnly | QIODevice::Text);
+        } else {
+            fileList.setFileName(path);
+            opened = fileList.open(QIODevice::ReadOnly | QIODevice::Text);
+        }
+        if (!opened) {
+            return usageError(QStringLiteral("Cannot read file list: %1").arg(path));
+        }
+    }
+
+    QFile output;
+    bool outputOpened = false;
+    if (parser.isSet(outputOption)) {
+        output.setFileName(parser.value(outputOption));
+        outputOpened = output.open(QIODevice::WriteOnly | QIODevice::Truncate);
+    } else {
+        outputOpened = output.open(stdout, QIODevice::WriteOnly);
+    }
+    if (!outputOpened) {
+        return usageError(QStringLiteral("Cannot write to %1").arg(parser.value(outputOption)));
+    }
+
+    // Pages in flight, counting both those being extracted and those
+    // waiting for an earlier page to be written
+    const qsizetype window = 4 * static_cast<qsizetype>(jobs);
+    BoundedQueue<ExtractJob> workQueue(window);
+    BoundedQueue<std::future<QByteArray>> lineQueue(window);
+    std::atomic_int failed(0);
+    int extracted = 0;
+    int documents = 0;
+
+    std::vector<std::unique_ptr<QThread>> workers;
+    for (int i = 0; i < jobs; ++i) {
+        workers.emplace_back(QThread::create([&workQueue, withWords]() {
+            while (std::optional<ExtractJob> job = workQueue.pop()) {
+                job->line.set_value(pageLine(*job->document, job->pageIndex, withWords));
+                // The last page of a document closes it here
+            }
+        }));
+    }
+
+    // Written in queue order, which is the order the pages were queued in
+    std::unique_ptr<QThread> writer(QThread::create([&lineQueue, &output, &failed]() {
+        bool writable = true;
+        while (std::optional<std::future<QByteArray>> line = lineQueue.pop()) {
+            QByteArray bytes = line->get();
+            if (writable && output.write(bytes) != bytes.size()) {
+                qWarning().noquote() << "Failed to write output:" << output.errorString();
+                writable = false;
+                ++failed;
+            }
+        }
+        output.flush();
+    }));
+
+    for (const auto& worker : workers) {
+        worker->start();
+    }
+    writer->start();
+
+    QElapsedTimer timer;
+    timer.start();
+
+    auto writeError = [&lineQueue, &failed](const QString& filePath, const QString& message) {
+        qWarning().noquote() << message << filePath;
+        std::promise<QByteArray> line;
+        line.set_value(errorLine(filePath, message));
+        lineQueue.push(line.get_future());
+        ++failed;
+    };
+
+    auto extractFile = [&](const QString& filePath) {
+        std::unique_ptr<DocumentReader> reader = DocumentFactory::createReader(filePath);
+        if (!reader) {
+            writeError(filePath, "Unsupported format");
+            return;
+        }
+
+        // Each page is read once; indexing the whole document or measuring
+        // every page up front would be wasted
+        reader->setBackgroundWork(false);
+        if (!reader->load(filePath)) {
+            writeError(filePath, "Failed to open");
+            return;
+        }
+        if (!reader->supportsTextExtraction()) {
+            qWarning().noquote() << "No text to extract from" << filePath;
+            return;
+        }
+
+        std::shared_ptr<const DocumentReader> document(std::move(reader));
+        ++documents;
+        for (int pageIndex : pages.pages(document->pageCount())) {
+            ExtractJob job{document, pageIndex, std::promise<QByteArray>()};
+            // The slot goes first so the writer never waits on a page that
+            // is not queued for extraction
+            lineQueue.push(job.line.get_future());
+            workQueue.push(std::move(job));
+            ++extracted;
+        }
+    };
+
+    for (const QString& filePath : files) {
+        extractFile(filePath);
+    }
+    if (fileList.isOpen()) {
+        // Streamed rather than read up front; the list may be long
+        QTextStream list(&fileList);
+        QString filePath;
+        while (list.readLineInto(&filePath)) {
+            filePath = filePath.trimmed();
+            if (!filePath.isEmpty()) {
+                extractFile(filePath);
+            }
+        }
+    }
+
+    workQueue.close();
+    for (const auto& worker : workers) {
+        worker->wait();
+    }
+    lineQueue.close();
+    writer->wait();
+
+    double seconds = timer.elapsed() / 1000.0;
+    err << QStringLiteral("Extracted %1 pages from %2 documents in %3 s (%4 pages/s)")
+               .arg(extracted)
+               .arg(documents)
+               .arg(seconds, 0, 'f', 2)
+               .arg(seconds > 0 ? extracted / seconds : 0.0, 0, 'f', 1)
+        << Qt::endl;
+    if (failed > 0) {
+        err << failed.load() << " failed" << Qt::endl;
+        return ExitFailures;
+    }
+    return ExitOk;
+}
@@ -0,0 +1,58 @@
+#include "pageranges.h"
+#include <algorithm>
+#include <numeric>
+#include <vector>
+
+bool PageRanges::parse(const QString& text)
+{
+    m_ranges.clear();
+    for (const QString& part : text.split(u',', Qt::SkipEmptyParts)) {
+        QString range = part.trimmed();
+        qsizetype dash = range.indexOf(u'-');
+        QString firstText = dash < 0 ? range : range.left(dash).trimmed();
+        QString lastText = dash < 0 ? range : range.mid(dash + 1).trimmed();
+
+        bool ok = true;
+        int first = firstText.isEmpty() ? 1 : firstText.toInt(&ok);
+        if (!ok || first < 1) {
+            m_ranges.clear();
+            return false;
+        }
+        // Only an omitted last page is open-ended; "5-0" is an error
+        int last = TO_END;
+        if (!lastText.isEmpty()) {
+            last = lastText.toInt(&ok);
+            if (!ok || last < first) {
+                m_ranges.clear();
+                return false;
+            }
+        }
+        m_ranges.append({first, last});
+    }
+    return !m_ranges.isEmpty();
+}
+
+QList<int> PageRanges::pages(int pageCount) const
+{
+    if (m_ranges.isEmpty()) {
+        QList<int> pages(std::max(0, pageCount));
+        std::iota(pages.begin(), pages.end(), 0);
+        return pages;
+    }
+
+    std::vector<bool> selected(std::max(0, pageCount), false);
+    for (const Range& range : m_ranges) {
+        int last = range.last == TO_END ? pageCount : std::min(range.last, pageCount);
+        for (int page = range.first; page <= last; ++page) {
+            selected[page - 1] = true;
+        }
+    }
+
+    QList<int> pages;
+    for (int i = 0; i < pageCount; ++i) {
+        if (selected[i]) {
+            pages.append(i);
+        }
+    }
+    return pages;
+}
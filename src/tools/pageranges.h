@@ -0,0 +1,41 @@
+#pragma once
+
+#include <QList>
+#include <QString>
+
+/**
+ * Pages picked on the command line, such as "1-3,7,10-".
+ *
+ * Page numbers are 1-based as users write them. A range with no first page
+ * starts at page 1, one with no last page runs to the end of the document.
+ * Without any ranges every page is selected.
+ */
+class PageRanges
+{
+public:
+    /**
+     * Parse a comma-separated list of pages and ranges, replacing any
+     * parsed before.
+     * @return false if the text is empty or malformed
+     */
+    bool parse(const QString& text);
+
+    /**
+     * Selected pages of a document, 0-based, in order and without repeats.
+     * Pages past the end of the document are left out.
+     */
+    QList<int> pages(int pageCount) const;
+
+    bool isEmpty() const { return m_ranges.isEmpty(); }
+
+private:
+    // Inclusive; a last page of TO_END means up to the end
+    struct Range {
+        int first;
+        int last;
+    };
+
+    static constexpr int TO_END = -1;
+
+    QList<Range> m_ranges;
+};
@@ -1,58 +1,112 @@
 #include "documentviewer.h"
 #include "../document/documentreader.h"
-#include <QVBoxLayout>
+#include "../document/renderqueue.h"
+#include "../config.h"
 #include <QScrollBar>
+#include <QPainter>
 #include <QApplication>
 #include <QMouseEvent>
 #include <QWheelEvent>
 #include <QResizeEvent>
 #include <QDebug>
+#include <QSet>
+#include <algorithm>
 #include <cmath>
 
 DocumentViewer::DocumentViewer(QWidget *parent)
     : QScrollArea(parent)
     , m_document(nullptr)
-    , m_imageLabel(nullptr)
+    , m_renderCache(static_cast<qint64>(DEFAULT_RENDER_CACHE_MB) * 1024 * 1024)
+    , m_renderQueue(nullptr)
+    , m_searchHitCount(0)
+    , m_currentHitPage(-1)
+    , m_currentHitIndex(-1)
     , m_currentPage(0)
     , m_zoomFactor(1.0)
     , m_dpi(96.0) // Standard screen DPI
+    , m_viewMode(ViewMode::SinglePage)
+    , m_scrollingTo(false)
     , m_dragging(false)
     , m_fitMode(FitMode::None)
+    , m_navDirection(0)
+    , m_navStreak(0)
+    , m_navFast(false)
+    , m_shownPageBytes(0)
 {
-    setWidgetResizable(true);
-    setAlignment(Qt::AlignCenter);
+    // No content widget: pages are painted straight onto the viewport and
+    // the scroll bars are driven by updateScrollBars(), so a page never has
+    // to exist as one widget-sized bitmap
     setBackgroundRole(QPalette::Dark);
     
-    m_imageLabel = new QLabel;
-    m_imageLabel->setAlignment(Qt::AlignCenter);
-    m_imageLabel->setScaledContents(false);
-    m_imageLabel->setBackgroundRole(QPalette::Base);
-    m_imageLabel->setAutoFillBackground(true);
-    m_imageLabel->setMinimumSize(100, 100);
+    // Pages are rasterized on worker threads and posted back here
+    m_renderQueue = new RenderQueue(this);
+    connect(m_renderQueue, &RenderQueue::rendered, this, &DocumentViewer::onPageRendered);
     
-    setWidget(m_imageLabel);
+    m_settleTimer.setSingleShot(true);
+    m_settleTimer.setInterval(GESTURE_SETTLE_MS);
+    connect(&m_settleTimer, &QTimer::timeout, this, &DocumentViewer::settleGesture);
     
     // Set up mouse tracking for panning
     setMouseTracking(true);
-    m_imageLabel->setMouseTracking(true);
+    viewport()->setMouseTracking(true);
+    
+    showMessage("No document loaded");
 }
 
-DocumentViewer::~DocumentViewer() = default;
+DocumentViewer::~DocumentViewer()
+{
+    if (m_document) {
+        m_document->setPageGeometryCallback(nullptr);
+    }
+    m_renderQueue->cancelAll();
+    m_renderQueue->waitForDone();
+}
 
 void DocumentViewer::setDocument(DocumentReader* document)
 {
+    // Workers must be done with the previous document before the caller
+    // is allowed to destroy it
+    m_renderQueue->cancelAll();
+    m_renderQueue->waitForDone();
+    
+    // Renders of the previous document are never shown again, and its
+    // address may be reused by the next reader
+    m_renderCache.removeDocument(m_document);
+    if (m_document) {
+        m_document->setPageGeometryCallback(nullptr);
+    }
+    
     m_document = document;
+    if (m_document) {
+        // Called on the reader's thread once it has measured every page
+        m_document->setPageGeometryCallback([this]() {
+            QMetaObject::invokeMethod(this, &DocumentViewer::onPageGeometryReady, Qt::QueuedConnection);
+        });
+    }
     m_currentPage = 0;
     m_zoomFactor = 1.0;
     m_fitMode = FitMode::None;
+    m_navDirection = 0;
+    m_navStreak = 0;
+    m_navFast = false;
+    m_navClock.invalidate();
+    m_layout.clear();
+    m_pageSizes.clear();
+    m_searchHits.clear();
+    m_searchHitCount = 0;
+    m_currentHitPage = -1;
+    m_currentHitIndex = -1;
+    m_settleTimer.stop();
+    
+    horizontalScrollBar()->setValue(0);
+    verticalScrollBar()->setValue(0);
     
     if (m_document && m_document->isLoaded()) {
         renderCurrentPage();
         emit pageChanged(m_currentPage);
         emit zoomChanged(m_zoomFactor);
     } else {
-        m_imageLabel->clear();
-        m_imageLabel->setText("No document loaded");
+        showMessage("No document loaded");
     }
 }
 
@@ -66,6 +120,108 @@ double DocumentViewer::zoomFactor() const
     return m_zoomFactor;
 }
 
+DocumentViewer::ViewMode DocumentViewer::viewMode() const
+{
+    return m_viewMode;
+}
+
+void DocumentViewer::setRenderCacheBudget(qint64 bytes)
+{
+    m_renderCache.setBudget(bytes);
+}
+
+RenderCache::Stats DocumentViewer::renderCacheStats() const
+{
+    return m_renderCache.stats();
+}
+
+void DocumentViewer::setPreviewProvider(const std::function<QPixmap(int)>& provider)
+{
+    m_previewProvider = provider;
+}
+
+void DocumentViewer::addSearchHits(int pageIndex, const QList<QRectF>& hits)
+{
+    if (hits.isEmpty()) {
+        return;
+    }
+    
+    m_searchHitCount -= m_searchHits.value(pageIndex).size();
+    m_searchHits.insert(pageIndex, hits);
+    m_searchHitCount += hits.size();
+    
+    if (m_layout.contains(pageIndex)) {
+        viewport()->update(m_layout.pageRect(pageIndex).translated(contentOrigin()));
+    }
+}
+
+void DocumentViewer::clearSearchHits()
+{
+    m_searchHits.clear();
+    m_searchHitCount = 0;
+    m_currentHitPage = -1;
+    m_currentHitIndex = -1;
+    viewport()->update();
+}
+
+int DocumentViewer::searchHitCount() const
+{
+    return m_searchHitCount;
+}
+
+void DocumentViewer::findNext()
+{
+    if (m_searchHits.isEmpty()) {
+        return;
+    }
+    
+    int previousPage = m_currentHitPage;
+    int previousIndex = m_currentHitIndex;
+    
+    auto it = m_searchHits.find(m_currentHitPage);
+    if (it != m_searchHits.end() && m_currentHitIndex + 1 < it.value().size()) {
+        ++m_currentHitIndex;
+    } else {
+        // First hit on the next page with hits, starting from the page on
+        // screen when nothing is current yet, wrapping at the end
+        it = m_currentHitPage < 0 ? m_searchHits.lowerBound(m_currentPage)
+                                  : m_searchHits.upperBound(m_currentHitPage);
+        if (it == m_searchHits.end()) {
+            it = m_searchHits.begin();
+        }
+        m_currentHitPage = it.key();
+        m_currentHitIndex = 0;
+    }
+    
+    showCurrentHit(previousPage, previousIndex);
+}
+
+void DocumentViewer::findPrevious()
+{
+    if (m_searchHits.isEmpty()) {
+        return;
+    }
+    
+    int previousPage = m_currentHitPage;
+    int previousIndex = m_currentHitIndex;
+    
+    if (m_currentHitPage >= 0 && m_currentHitIndex > 0) {
+        --m_currentHitIndex;
+    } else {
+        // Last hit on the previous page with hits, wrapping at the start
+        int from = m_currentHitPage < 0 ? m_currentPage + 1 : m_currentHitPage;
+        auto it = m_searchHits.lowerBound(from);
+        if (it == m_searchHits.begin()) {
+            it = m_searchHits.end();
+        }
+        --it;
+        m_currentHitPage = it.key();
+        m_currentHitIndex = it.value().size() - 1;
+    }
+    
+    showCurrentHit(previousPage, previousIndex);
+}
+
 void DocumentViewer::goToPage(int pageIndex)
 {
     if (!m_document || !m_document->isLoaded()) {
@@ -76,8 +232,21 @@ void DocumentViewer::goToPage(int pageIndex)
         return;
     }
     
+    recordNavigation(m_currentPage, pageIndex);
+    showPage(pageIndex);
+}
+
+void DocumentViewer::showPage(int pageIndex)
+{
     m_currentPage = pageIndex;
-    renderCurrentPage();
+    
+    if (m_viewMode == ViewMode::Continuous && m_layout.contains(pageIndex)) {
+        // Scroll the page to the top; the scroll handler renders what
+        // comes into view
+        scrollTo(horizontalScrollBar()->value(), m_layout.pageRect(pageIndex).top() - PAGE_SPACING);
+    } else {
+        renderCurrentPage();
+    }
     emit pageChanged(m_currentPage);
 }
 
@@ -126,11 +295,8 @@ void DocumentViewer::setZoom(double factor)
         return; // No significant change
     }
     
-    m_zoomFactor = factor;
     m_fitMode = FitMode::None;
-    
-    renderCurrentPage();
-    emit zoomChanged(m_zoomFactor);
+    applyZoom(factor);
 }
 
 void DocumentViewer::fitToWidth()
@@ -140,11 +306,7 @@ void DocumentViewer::fitToWidth()
     }
     
     m_fitMode = FitMode::Width;
-    double zoom = calculateFitToWidthZoom();
-    m_zoomFactor = zoom;
-    
-    renderCurrentPage();
-    emit zoomChanged(m_zoomFactor);
+    applyZoom(calculateFitToWidthZoom());
 }
 
 void DocumentViewer::fitToPage()
@@ -154,11 +316,7 @@ void DocumentViewer::fitToPage()
     }
     
     m_fitMode = FitMode::Page;
-    double zoom = calculateFitToPageZoom();
-    m_zoomFactor = zoom;
-    
-    renderCurrentPage();
-    emit zoomChanged(m_zoomFactor);
+    applyZoom(calculateFitToPageZoom());
 }
 
 void DocumentViewer::actualSize()
@@ -166,10 +324,36 @@ void DocumentViewer::actualSize()
     setZoom(1.0);
 }
 
+void DocumentViewer::setViewMode(ViewMode mode)
+{
+    if (mode == m_viewMode) {
+        return;
+    }
+    
+    m_viewMode = mode;
+    if (!m_document || !m_document->isLoaded()) {
+        return;
+    }
+    
+    // Stay on the same page across the switch
+    renderCurrentPage();
+    if (m_viewMode == ViewMode::Continuous) {
+        scrollTo(horizontalScrollBar()->value(), m_layout.pageRect(m_currentPage).top() - PAGE_SPACING);
+    } else {
+        verticalScrollBar()->setValue(0);
+    }
+}
+
+void DocumentViewer::setContinuousScroll(bool enabled)
+{
+    setViewMode(enabled ? ViewMode::Continuous : ViewMode::SinglePage);
+}
+
 void DocumentViewer::wheelEvent(QWheelEvent* event)
 {
     if (event->modifiers() & Qt::ControlModifier) {
-        // Zoom with Ctrl+Wheel
+        // Zoom with Ctrl+Wheel; renders once the wheel stops
+        beginGesture();
         if (event->angleDelta().y() > 0) {
             zoomIn();
         } else {
@@ -225,12 +409,54 @@ void DocumentViewer::resizeEvent(QResizeEvent* event)
 {
     QScrollArea::resizeEvent(event);
     
-    // Reapply fit modes when window is resized
+    // Reapply fit modes when window is resized. Dragging a window edge
+    // delivers a stream of these, so the zoom follows at once but rendering
+    // waits until the drag settles
     if (m_fitMode == FitMode::Width) {
+        beginGesture();
         fitToWidth();
     } else if (m_fitMode == FitMode::Page) {
+        beginGesture();
         fitToPage();
+    } else {
+        updateScrollBars();
+        requestVisible();
+    }
+}
+
+void DocumentViewer::paintEvent(QPaintEvent* event)
+{
+    QPainter painter(viewport());
+    
+    if (!m_message.isEmpty()) {
+        painter.setPen(palette().color(QPalette::Text));
+        painter.drawText(viewport()->rect(), Qt::AlignCenter, m_message);
+        return;
+    }
+    
+    if (m_layout.isEmpty()) {
+        return;
     }
+    
+    // Only the pages crossing the exposed area are looked at
+    QPoint origin = contentOrigin();
+    QRect exposed = event->rect();
+    int first = m_layout.pageAt(exposed.top() - origin.y());
+    int last = m_layout.pageAt(exposed.bottom() - origin.y());
+    for (int page = first; page <= last; ++page) {
+        QRect pageRect = m_layout.pageRect(page).translated(origin);
+        paintPage(painter, page, pageRect, exposed);
+        paintSearchHits(painter, page, pageRect, exposed);
+    }
+}
+
+void DocumentViewer::scrollContentsBy(int dx, int dy)
+{
+    // Blit what is already painted; only the exposed strip is repainted
+    viewport()->scroll(dx, dy);
+    
+    updateCurrentPageFromScroll();
+    requestVisible();
 }
 
 void DocumentViewer::updateDisplay()
@@ -241,31 +467,578 @@ void DocumentViewer::updateDisplay()
 void DocumentViewer::renderCurrentPage()
 {
     if (!m_document || !m_document->isLoaded()) {
-        m_imageLabel->clear();
-        m_imageLabel->setText("No document loaded");
+        showMessage("No document loaded");
         return;
     }
     
     if (m_currentPage < 0 || m_currentPage >= m_document->pageCount()) {
-        m_imageLabel->clear();
-        m_imageLabel->setText("Invalid page");
+        showMessage("Invalid page");
         return;
     }
     
-    // Calculate DPI based on zoom factor
-    double renderDpi = m_dpi * m_zoomFactor;
+    m_message.clear();
+    updateLayout();
+    viewport()->update();
+    
+    // Count the lookup of the page being shown and refresh its LRU position.
+    // Mid-gesture the size is not final and settleGesture() comes back here,
+    // so looking up each passing size would only count misses
+    RenderKey key = renderKeyFor(m_currentPage);
+    if (!m_settleTimer.isActive() && !usesTiles(m_layout.pageRect(m_currentPage).size())) {
+        QPixmap pixmap = m_renderCache.find(key);
+        if (!pixmap.isNull()) {
+            m_shownPageBytes = RenderCache::costOf(pixmap);
+            emit pageRendered(m_currentPage); // Nothing more will arrive for it
+        }
+    }
+    
+    requestVisible();
+}
+
+void DocumentViewer::onPageRendered(const RenderKey& key, const QImage& image)
+{
+    QPixmap pixmap = QPixmap::fromImage(image);
+    m_renderCache.insert(key, pixmap);
+    
+    if (!m_document || !m_layout.contains(key.pageIndex)) {
+        return; // The user moved on while this page was rendering
+    }
     
-    // Render the page
-    QPixmap pixmap = m_document->renderPage(m_currentPage, renderDpi);
+    QRect pageRect = m_layout.pageRect(key.pageIndex).translated(contentOrigin());
+    
+    if (key.dpiCenti != renderKeyFor(key.pageIndex).dpiCenti) {
+        // A preview or a render for an earlier zoom level; it can still
+        // stand in for whatever has not been rendered yet
+        if (!key.isTile()) {
+            viewport()->update(pageRect);
+        }
+        return;
+    }
+    
+    if (key.isTile()) {
+        viewport()->update(key.tile.translated(pageRect.topLeft()));
+        if (key.pageIndex == m_currentPage) {
+            emit pageRendered(key.pageIndex); // A tiled page never finishes as a whole
+        }
+        return;
+    }
     
     if (pixmap.isNull()) {
-        m_imageLabel->clear();
-        m_imageLabel->setText("Failed to render page");
+        if (m_viewMode == ViewMode::SinglePage && key.pageIndex == m_currentPage) {
+            showMessage("Failed to render page");
+        }
+        if (key.pageIndex == m_currentPage) {
+            emit pageRendered(key.pageIndex);
+        }
+        return;
+    }
+    
+    viewport()->update(pageRect);
+    
+    if (key.pageIndex == m_currentPage) {
+        m_shownPageBytes = RenderCache::costOf(pixmap);
+    
+        // The visible page is done; use the idle workers for its neighbours
+        schedulePrefetch();
+        emit pageRendered(key.pageIndex);
+    }
+}
+
+void DocumentViewer::showMessage(const QString& message)
+{
+    m_message = message;
+    m_layout.clear();
+    updateScrollBars();
+    viewport()->update();
+}
+
+void DocumentViewer::applyZoom(double factor)
+{
+    // Keep the point under the viewport centre in place
+    QSize oldSize = m_layout.size();
+    QPointF anchor(0.5, 0.5);
+    if (!oldSize.isEmpty()) {
+        anchor.setX((horizontalScrollBar()->value() + viewport()->width() / 2.0) / oldSize.width());
+        anchor.setY((verticalScrollBar()->value() + viewport()->height() / 2.0) / oldSize.height());
+    }
+    
+    m_zoomFactor = factor;
+    updateLayout();
+    
+    QSize newSize = m_layout.size();
+    scrollTo(qRound(anchor.x() * newSize.width() - viewport()->width() / 2.0),
+             qRound(anchor.y() * newSize.height() - viewport()->height() / 2.0));
+    
+    renderCurrentPage();
+    emit zoomChanged(m_zoomFactor);
+}
+
+void DocumentViewer::updateLayout()
+{
+    double scale = renderDpi() / 72.0;
+    
+    if (m_viewMode == ViewMode::Continuous && m_document->pageGeometryReady()) {
+        // Page sizes are fetched once per document; zooming only rescales
+        if (m_pageSizes.size() != m_document->pageCount()) {
+            m_pageSizes.clear();
+            m_pageSizes.reserve(m_document->pageCount());
+            for (int i = 0; i < m_document->pageCount(); ++i) {
+                m_pageSizes.append(m_document->pageSize(i));
+            }
+        }
+        if (m_layout.firstPage() != 0 || m_layout.lastPage() != m_pageSizes.size() - 1) {
+            m_layout.setPages(m_pageSizes);
+        }
+        m_layout.setScale(scale, PAGE_SPACING);
+    } else {
+        // Laying out every page now would ask the backend for each page
+        // size on this thread; in continuous mode the current page is shown
+        // alone until the document reports its pages measured
+        m_layout.setPages({m_document->pageSize(m_currentPage)}, m_currentPage);
+        m_layout.setScale(scale, 0);
+    }
+    
+    updateScrollBars();
+}
+
+void DocumentViewer::onPageGeometryReady()
+{
+    if (!m_document || !m_document->isLoaded() || m_viewMode != ViewMode::Continuous) {
+        return;
+    }
+    
+    // Posted from the reader's thread; the document may have changed since,
+    // or the strip may already have been laid out
+    if (!m_document->pageGeometryReady() || m_pageSizes.size() == m_document->pageCount()) {
+        return;
+    }
+    
+    // Switch from the single page stand-in to the full strip in place
+    renderCurrentPage();
+    scrollTo(horizontalScrollBar()->value(), m_layout.pageRect(m_currentPage).top() - PAGE_SPACING);
+}
+
+void DocumentViewer::updateCurrentPageFromScroll()
+{
+    if (m_viewMode != ViewMode::Continuous || m_layout.isEmpty() || m_scrollingTo) {
+        return;
+    }
+    
+    // The page under the middle of the viewport is the current one
+    int page = m_layout.pageAt(-contentOrigin().y() + viewport()->height() / 2);
+    if (page != m_currentPage) {
+        m_currentPage = page;
+        emit pageChanged(m_currentPage);
+    }
+}
+
+void DocumentViewer::scrollTo(int x, int y)
+{
+    // Moving the view to a page or keeping it in place across a zoom leaves
+    // the current page to the caller; near the end of the document the page
+    // at the centre is not the one scrolled to. Only the user scrolling
+    // makes the page at the centre current.
+    m_scrollingTo = true;
+    horizontalScrollBar()->setValue(x);
+    verticalScrollBar()->setValue(y);
+    m_scrollingTo = false;
+}
+
+double DocumentViewer::renderDpi() const
+{
+    // Calculate DPI based on zoom factor, rounded like RenderKey stores it
+    return std::round(m_dpi * m_zoomFactor * 100.0) / 100.0;
+}
+
+RenderKey DocumentViewer::renderKeyFor(int pageIndex, const QRect& tile) const
+{
+    return RenderKey(m_document, pageIndex, renderDpi(), m_document ? m_document->renderHints() : 0, tile);
+}
+
+RenderKey DocumentViewer::previewKeyFor(int pageIndex) const
+{
+    return RenderKey(m_document, pageIndex, PREVIEW_DPI, m_document ? m_document->renderHints() : 0);
+}
+
+QPoint DocumentViewer::contentOrigin() const
+{
+    // Centre content smaller than the viewport, otherwise follow the scroll bars
+    QSize size = m_layout.size();
+    int x = size.width() < viewport()->width()
+        ? (viewport()->width() - size.width()) / 2
+        : -horizontalScrollBar()->value();
+    int y = size.height() < viewport()->height()
+        ? (viewport()->height() - size.height()) / 2
+        : -verticalScrollBar()->value();
+    return QPoint(x, y);
+}
+
+bool DocumentViewer::usesTiles(const QSize& pagePixels) const
+{
+    return static_cast<qint64>(pagePixels.width()) * pagePixels.height() * 4 > TILED_RENDER_MIN_BYTES;
+}
+
+QList<QRect> DocumentViewer::tilesIn(const QSize& pagePixels, const QRect& area) const
+{
+    QList<QRect> tiles;
+    QRect page(QPoint(0, 0), pagePixels);
+    QRect clipped = area.intersected(page);
+    if (clipped.isEmpty()) {
+        return tiles;
+    }
+    
+    // Tiles sit on a fixed grid so the same tile is reused while panning
+    for (int row = clipped.top() / TILE_SIZE; row <= clipped.bottom() / TILE_SIZE; ++row) {
+        for (int col = clipped.left() / TILE_SIZE; col <= clipped.right() / TILE_SIZE; ++col) {
+            tiles.append(QRect(col * TILE_SIZE, row * TILE_SIZE, TILE_SIZE, TILE_SIZE).intersected(page));
+        }
+    }
+    return tiles;
+}
+
+void DocumentViewer::beginGesture()
+{
+    if (m_layout.isEmpty()) {
+        return; // Nothing shown yet, render right away
+    }
+    
+    // Queued renders are for a size that is about to change again
+    if (!m_settleTimer.isActive()) {
+        m_renderQueue->cancelAll();
+    }
+    m_settleTimer.start();
+}
+
+void DocumentViewer::settleGesture()
+{
+    if (m_document && m_document->isLoaded()) {
+        renderCurrentPage();
+    }
+}
+
+void DocumentViewer::requestVisible()
+{
+    if (!m_document || !m_message.isEmpty() || m_layout.isEmpty()) {
+        return;
+    }
+    
+    // Mid-gesture, paintPage() scales the closest existing render instead
+    if (m_settleTimer.isActive()) {
+        return;
+    }
+    
+    // Viewport in layout coordinates, plus a guard band to scroll into:
+    // a margin of tiles when panning one page, whole viewports above and
+    // below in continuous mode
+    QRect visible(-contentOrigin(), viewport()->size());
+    int guard = m_viewMode == ViewMode::Continuous
+        ? viewport()->height() * GUARD_BAND_VIEWPORTS
+        : TILE_MARGIN;
+    QRect guarded = visible.adjusted(-TILE_MARGIN, -guard, TILE_MARGIN, guard);
+    QPoint centre = visible.center();
+    
+    struct Job {
+        RenderKey key;
+        int priority;
+        int distance;
+    };
+    QList<Job> jobs;
+    QSet<RenderKey> wanted;
+    
+    int first = m_layout.pageAt(guarded.top());
+    int last = m_layout.pageAt(guarded.bottom());
+    for (int page = first; page <= last; ++page) {
+        QRect pageRect = m_layout.pageRect(page);
+        if (!pageRect.intersects(guarded)) {
+            continue;
+        }
+        bool onScreen = pageRect.intersects(visible);
+        RenderKey pageKey = renderKeyFor(page);
+    
+        if (usesTiles(pageRect.size())) {
+            for (const QRect& tile : tilesIn(pageRect.size(), guarded.translated(-pageRect.topLeft()))) {
+                RenderKey key = renderKeyFor(page, tile);
+                wanted.insert(key);
+                if (!m_renderCache.contains(key)) {
+                    QRect area = tile.translated(pageRect.topLeft());
+                    int priority = area.intersects(visible) ? RenderQueue::VisiblePriority : RenderQueue::PrefetchPriority;
+                    jobs.append({key, priority, (area.center() - centre).manhattanLength()});
+                }
+            }
+        } else {
+            wanted.insert(pageKey);
+            if (!m_renderCache.contains(pageKey)) {
+                int priority = onScreen ? RenderQueue::VisiblePriority : RenderQueue::PrefetchPriority;
+                jobs.append({pageKey, priority, (pageRect.center() - centre).manhattanLength()});
+            }
+        }
+    
+        // Until the real render lands, paintPage() scales whatever stand-in
+        // exists; make sure on-screen pages have one. It outranks visible
+        // work: it is tiny and fills the screen in the meantime
+        if (onScreen && !m_renderCache.contains(pageKey)) {
+            RenderKey previewKey = previewKeyFor(page);
+            wanted.insert(previewKey);
+            if (renderDpi() > PREVIEW_DPI * 1.5 && previewFor(page).isNull()) {
+                jobs.append({previewKey, RenderQueue::PreviewPriority, 0});
+            }
+        }
+    }
+    
+    // Single page mode keeps its navigation-driven prefetch window
+    for (int page : prefetchPages()) {
+        wanted.insert(renderKeyFor(page));
+    }
+    
+    // Anything still queued outside the new window is stale now
+    m_renderQueue->cancelIf([&wanted](const RenderKey& pending) {
+        return !wanted.contains(pending);
+    });
+    
+    // Start with the work nearest the centre of the viewport
+    std::sort(jobs.begin(), jobs.end(), [](const Job& a, const Job& b) {
+        return a.distance < b.distance;
+    });
+    for (const Job& job : jobs) {
+        m_renderQueue->request(job.key, job.priority);
+    }
+    
+    if (m_renderCache.contains(renderKeyFor(m_currentPage))) {
+        schedulePrefetch();
+    }
+}
+
+void DocumentViewer::paintPage(QPainter& painter, int pageIndex, const QRect& pageRect, const QRect& exposed)
+{
+    QRect area = pageRect.intersected(exposed);
+    if (area.isEmpty()) {
         return;
     }
     
-    m_imageLabel->setPixmap(pixmap);
-    m_imageLabel->resize(pixmap.size());
+    // Paper colour shows through until the render arrives
+    painter.fillRect(area, Qt::white);
+    
+    // Stand-in for the parts that have not been rendered at this DPI yet,
+    // scaled by the painter; only looked up when something is missing
+    QPixmap preview;
+    bool previewLooked = false;
+    auto paintPreview = [&](const QRect& target) {
+        if (!previewLooked) {
+            preview = previewFor(pageIndex);
+            previewLooked = true;
+        }
+        if (preview.isNull()) {
+            return;
+        }
+        double sx = static_cast<double>(preview.width()) / pageRect.width();
+        double sy = static_cast<double>(preview.height()) / pageRect.height();
+        QRectF source((target.x() - pageRect.x()) * sx, (target.y() - pageRect.y()) * sy,
+                      target.width() * sx, target.height() * sy);
+        painter.drawPixmap(QRectF(target), preview, source);
+    };
+    
+    if (!usesTiles(pageRect.size())) {
+        QPixmap pixmap = m_renderCache.peek(renderKeyFor(pageIndex));
+        if (!pixmap.isNull()) {
+            painter.drawPixmap(pageRect.topLeft(), pixmap);
+        } else {
+            paintPreview(area);
+        }
+        return;
+    }
+    
+    for (const QRect& tile : tilesIn(pageRect.size(), area.translated(-pageRect.topLeft()))) {
+        QPixmap pixmap = m_renderCache.peek(renderKeyFor(pageIndex, tile));
+        if (!pixmap.isNull()) {
+            painter.drawPixmap(pageRect.topLeft() + tile.topLeft(), pixmap);
+        } else {
+            paintPreview(tile.translated(pageRect.topLeft()).intersected(area));
+        }
+    }
+}
+
+void DocumentViewer::paintSearchHits(QPainter& painter, int pageIndex, const QRect& pageRect, const QRect& exposed)
+{
+    auto it = m_searchHits.constFind(pageIndex);
+    if (it == m_searchHits.constEnd()) {
+        return;
+    }
+    
+    // Scaled from page points on every paint; nothing is rendered for it
+    double scale = renderDpi() / 72.0;
+    const QList<QRectF>& hits = it.value();
+    for (int i = 0; i < hits.size(); ++i) {
+        const QRectF& hit = hits[i];
+        QRectF area(pageRect.x() + hit.x() * scale, pageRect.y() + hit.y() * scale,
+                    hit.width() * scale, hit.height() * scale);
+        if (!area.intersects(exposed)) {
+            continue;
+        }
+        bool current = pageIndex == m_currentHitPage && i == m_currentHitIndex;
+        painter.fillRect(area, current ? QColor(255, 140, 0, 140) : QColor(255, 220, 0, 90));
+    }
+}
+
+QRect DocumentViewer::hitRect(int pageIndex, const QRectF& hit) const
+{
+    double scale = renderDpi() / 72.0;
+    QRect pageRect = m_layout.pageRect(pageIndex);
+    QRectF area(pageRect.x() + hit.x() * scale, pageRect.y() + hit.y() * scale,
+                hit.width() * scale, hit.height() * scale);
+    return area.toAlignedRect();
+}
+
+void DocumentViewer::showCurrentHit(int previousPage, int previousIndex)
+{
+    const QRectF& hit = m_searchHits[m_currentHitPage][m_currentHitIndex];
+    
+    // Only the two highlights change; the page bitmaps are reused as is
+    if (previousPage >= 0 && m_layout.contains(previousPage)) {
+        const QList<QRectF>& hits = m_searchHits[previousPage];
+        if (previousIndex >= 0 && previousIndex < hits.size()) {
+            viewport()->update(hitRect(previousPage, hits[previousIndex]).translated(contentOrigin()));
+        }
+    }
+    
+    // Not through goToPage(): jumping between hits says nothing about
+    // where the reader pages next, and must not steer prefetching
+    if (!m_layout.contains(m_currentHitPage)) {
+        showPage(m_currentHitPage);
+    }
+    
+    // Scroll the hit into view if it isn't already, centring it
+    QRect area = hitRect(m_currentHitPage, hit);
+    QRect visible(-contentOrigin(), viewport()->size());
+    if (!visible.contains(area)) {
+        horizontalScrollBar()->setValue(area.center().x() - viewport()->width() / 2);
+        verticalScrollBar()->setValue(area.center().y() - viewport()->height() / 2);
+    }
+    viewport()->update(area.translated(contentOrigin()));
+    
+    emit currentHitChanged(m_currentHitPage, hit);
+}
+
+QPixmap DocumentViewer::previewFor(int pageIndex) const
+{
+    // Prefer any render of this page at another zoom level, then fall back
+    // to the preview provider (thumbnails)
+    QPixmap pixmap = m_renderCache.closest(renderKeyFor(pageIndex));
+    if (pixmap.isNull() && m_previewProvider) {
+        pixmap = m_previewProvider(pageIndex);
+    }
+    return pixmap;
+}
+
+void DocumentViewer::updateScrollBars()
+{
+    QSize size = m_layout.size();
+    QSize view = viewport()->size();
+    
+    horizontalScrollBar()->setRange(0, std::max(0, size.width() - view.width()));
+    horizontalScrollBar()->setPageStep(view.width());
+    horizontalScrollBar()->setSingleStep(20);
+    
+    verticalScrollBar()->setRange(0, std::max(0, size.height() - view.height()));
+    verticalScrollBar()->setPageStep(view.height());
+    verticalScrollBar()->setSingleStep(20);
+}
+
+void DocumentViewer::recordNavigation(int fromPage, int toPage)
+{
+    int step = toPage - fromPage;
+    qint64 interval = m_navClock.isValid() ? m_navClock.restart() : -1;
+    if (!m_navClock.isValid()) {
+        m_navClock.start();
+    }
+    
+    if (std::abs(step) != 1) {
+        // A jump (go to page, thumbnail click) says nothing about direction
+        m_navDirection = 0;
+        m_navStreak = 0;
+        m_navFast = false;
+        return;
+    }
+    
+    if (step == m_navDirection) {
+        ++m_navStreak;
+    } else {
+        m_navDirection = step;
+        m_navStreak = 1;
+    }
+    m_navFast = interval >= 0 && interval < FAST_FLIP_MS;
+}
+
+QList<int> DocumentViewer::prefetchPages() const
+{
+    QList<int> pages;
+    if (!m_document || !m_document->isLoaded() || m_viewMode == ViewMode::Continuous) {
+        return pages; // Continuous mode renders a guard band around the viewport instead
+    }
+    
+    if (usesTiles(m_layout.pageRect(m_currentPage).size())) {
+        return pages; // Neighbours of a tiled page are far too big to keep
+    }
+    
+    // Read further ahead the longer and faster the user keeps paging in
+    // one direction; keep a single page on the other side
+    int ahead = PREFETCH_BASE_AHEAD;
+    if (m_navDirection != 0) {
+        ahead += m_navStreak / 2;
+        if (m_navFast) {
+            ahead *= 2;
+        }
+    }
+    ahead = std::min(ahead, PREFETCH_MAX_AHEAD);
+    int behind = PREFETCH_BEHIND;
+    
+    // Don't prefetch more than half the cache can hold at this zoom level,
+    // otherwise speculative pages would evict each other
+    if (m_shownPageBytes > 0) {
+        qint64 affordable = m_renderCache.budget() / 2 / m_shownPageBytes;
+        ahead = static_cast<int>(std::min<qint64>(ahead, affordable));
+        behind = static_cast<int>(std::min<qint64>(behind, std::max<qint64>(0, affordable - ahead)));
+    }
+    
+    int forward = m_navDirection < 0 ? -1 : 1;
+    int count = m_document->pageCount();
+    
+    // Nearest pages first so the queue order matches the likely next step
+    for (int distance = 1; distance <= std::max(ahead, behind); ++distance) {
+        if (distance <= ahead) {
+            int page = m_currentPage + forward * distance;
+            if (page >= 0 && page < count) {
+                pages.append(page);
+            }
+        }
+        if (distance <= behind) {
+            int page = m_currentPage - forward * distance;
+            if (page >= 0 && page < count) {
+                pages.append(page);
+            }
+        }
+    }
+    
+    return pages;
+}
+
+void DocumentViewer::schedulePrefetch()
+{
+    if (m_settleTimer.isActive()) {
+        return;
+    }
+    
+    QList<int> pages = prefetchPages();
+    if (!pages.isEmpty()) {
+        // Only whole pages shown one at a time get here, never tiles,
+        // previews or the guard band of continuous mode
+        m_document->pageShown(m_currentPage, renderDpi());
+    }
+    for (int i = 0; i < pages.size(); ++i) {
+        RenderKey key = renderKeyFor(pages[i]);
+        if (!m_renderCache.contains(key)) {
+            m_renderQueue->request(key, RenderQueue::PrefetchPriority - i);
+        }
+    }
 }
 
 double DocumentViewer::calculateFitToWidthZoom() const
@@ -2,24 +2,42 @@
 
 #include <QWidget>
 #include <QScrollArea>
-#include <QLabel>
 #include <QPixmap>
+#include <QPainter>
 #include <QMouseEvent>
 #include <QWheelEvent>
 #include <QResizeEvent>
+#include <QPaintEvent>
+#include <QElapsedTimer>
+#include <QTimer>
+#include <QMap>
+#include <QRectF>
+#include <functional>
+#include "pagelayout.h"
+#include "../document/rendercache.h"
 
 class DocumentReader;
+class RenderQueue;
 
 /**
  * Widget for displaying document pages with zoom and navigation capabilities.
  * This widget handles the main document viewing area with support for
  * zooming, panning, and page navigation.
+ * Pages are painted directly onto the viewport from a PageLayout, either one
+ * page at a time or as a continuous vertical strip. Only pages near the
+ * viewport are rendered, and at high zoom levels a page is rendered as tiles
+ * of which only those around the viewport exist.
  */
 class DocumentViewer : public QScrollArea
 {
     Q_OBJECT
 
 public:
+    enum class ViewMode {
+        SinglePage,
+        Continuous
+    };
+    
     explicit DocumentViewer(QWidget *parent = nullptr);
     ~DocumentViewer();
     
@@ -31,6 +49,7 @@ public:
     
     /**
      * Get the current page index (0-based).
+     * In continuous mode this is the page at the centre of the viewport.
      * @return Current page index
      */
     int currentPage() const;
@@ -41,6 +60,47 @@ public:
      */
     double zoomFactor() const;
     
+    /**
+     * Get the current view mode.
+     */
+    ViewMode viewMode() const;
+    
+    /**
+     * Set the memory budget of the rendered page cache.
+     * @param bytes Maximum size of cached page bitmaps in bytes
+     */
+    void setRenderCacheBudget(qint64 bytes);
+    
+    /**
+     * Get hit/miss and memory statistics of the rendered page cache.
+     */
+    RenderCache::Stats renderCacheStats() const;
+    
+    /**
+     * Set a source of cheap page images (e.g. thumbnails) that are scaled
+     * up and shown while a page is rendering and no other render exists.
+     * @param provider Returns a pixmap for a page index, or a null pixmap
+     */
+    void setPreviewProvider(const std::function<QPixmap(int)>& provider);
+    
+    /**
+     * Highlight search hits on a page. The highlights are painted over the
+     * page bitmaps, so showing them or moving between them never renders.
+     * @param pageIndex 0-based page index
+     * @param hits Hit rectangles in page points
+     */
+    void addSearchHits(int pageIndex, const QList<QRectF>& hits);
+    
+    /**
+     * Remove all search highlights.
+     */
+    void clearSearchHits();
+    
+    /**
+     * Get the number of highlighted search hits.
+     */
+    int searchHitCount() const;
+
 public slots:
     void goToPage(int pageIndex);
     void nextPage();
@@ -51,10 +111,16 @@ public slots:
     void fitToWidth();
     void fitToPage();
     void actualSize();
+    void setViewMode(ViewMode mode);
+    void setContinuousScroll(bool enabled);
+    void findNext();
+    void findPrevious();
 
 signals:
     void pageChanged(int pageIndex);
     void zoomChanged(double factor);
+    void currentHitChanged(int pageIndex, const QRectF& hit);
+    void pageRendered(int pageIndex); // Current page (or a tile of it) shown at the current zoom, or failed
 
 protected:
     void wheelEvent(QWheelEvent* event) override;
@@ -62,22 +128,64 @@ protected:
     void mouseMoveEvent(QMouseEvent* event) override;
     void mouseReleaseEvent(QMouseEvent* event) override;
     void resizeEvent(QResizeEvent* event) override;
+    void paintEvent(QPaintEvent* event) override;
+    void scrollContentsBy(int dx, int dy) override;
 
 private slots:
     void updateDisplay();
+    void onPageRendered(const RenderKey& key, const QImage& image);
+    void onPageGeometryReady();
+    void settleGesture();
 
 private:
     void renderCurrentPage();
+    void showPage(int pageIndex);
+    void showMessage(const QString& message);
+    void applyZoom(double factor);
+    void updateLayout();
+    void updateCurrentPageFromScroll();
+    void scrollTo(int x, int y);
+    double renderDpi() const;
+    RenderKey renderKeyFor(int pageIndex, const QRect& tile = QRect()) const;
+    RenderKey previewKeyFor(int pageIndex) const;
+    QPoint contentOrigin() const;
+    bool usesTiles(const QSize& pagePixels) const;
+    QList<QRect> tilesIn(const QSize& pagePixels, const QRect& area) const;
+    void requestVisible();
+    void beginGesture();
+    void paintPage(QPainter& painter, int pageIndex, const QRect& pageRect, const QRect& exposed);
+    QPixmap previewFor(int pageIndex) const;
+    void paintSearchHits(QPainter& painter, int pageIndex, const QRect& pageRect, const QRect& exposed);
+    QRect hitRect(int pageIndex, const QRectF& hit) const;
+    void showCurrentHit(int previousPage, int previousIndex);
+    void recordNavigation(int fromPage, int toPage);
+    QList<int> prefetchPages() const;
+    void schedulePrefetch();
     void updateScrollBars();
     double calculateFitToWidthZoom() const;
     double calculateFitToPageZoom() const;
     
     DocumentReader* m_document;
-    QLabel* m_imageLabel;
+    RenderCache m_renderCache;
+    RenderQueue* m_renderQueue;
+    
+    PageLayout m_layout;
+    QList<QSizeF> m_pageSizes; // Sizes of all pages in points, for continuous mode
+    QTimer m_settleTimer;      // Running while a resize or zoom gesture is in progress
+    QString m_message;         // Shown instead of pages when non-empty
+    std::function<QPixmap(int)> m_previewProvider;
+    
+    // Search hits by page, in page points; the current hit is drawn stronger
+    QMap<int, QList<QRectF>> m_searchHits;
+    int m_searchHitCount;
+    int m_currentHitPage;  // -1 when no hit is current
+    int m_currentHitIndex;
     
     int m_currentPage;
     double m_zoomFactor;
     double m_dpi;
+    ViewMode m_viewMode;
+    bool m_scrollingTo; // Inside scrollTo(); the current page is not taken from the scroll position
     
     // Mouse interaction
     bool m_dragging;
@@ -90,4 +198,33 @@ private:
         Page
     };
     FitMode m_fitMode;
+    
+    // Navigation history used to size the prefetch window
+    QElapsedTimer m_navClock;
+    int m_navDirection; // +1 forward, -1 backward, 0 unknown
+    int m_navStreak;    // Consecutive single-page steps in m_navDirection
+    bool m_navFast;     // Last step came quickly after the previous one
+    qint64 m_shownPageBytes; // Size of the last shown render, to bound prefetch
+    
+    static constexpr int PREFETCH_BASE_AHEAD = 2;
+    static constexpr int PREFETCH_MAX_AHEAD = 8;
+    static constexpr int PREFETCH_BEHIND = 1;
+    static constexpr int FAST_FLIP_MS = 600;
+    
+    // Pages whose full bitmap would exceed this are rendered as tiles
+    static constexpr qint64 TILED_RENDER_MIN_BYTES = 32 * 1024 * 1024;
+    static constexpr int TILE_SIZE = 512;
+    static constexpr int TILE_MARGIN = TILE_SIZE / 2;
+    
+    // Resolution of the quick render shown before the real one arrives
+    static constexpr double PREVIEW_DPI = 36.0;
+    
+    // Continuous mode: gap between pages, and how many viewport heights
+    // above and below the viewport are rendered ahead of scrolling
+    static constexpr int PAGE_SPACING = 10;
+    static constexpr int GUARD_BAND_VIEWPORTS = 1;
+    
+    // Quiet time after the last resize or wheel zoom step before pages are
+    // rendered at the new size
+    static constexpr int GESTURE_SETTLE_MS = 150;
 };
@@ -0,0 +1,108 @@
+#include "pagelayout.h"
+#include <algorithm>
+#include <climits>
+#include <cmath>
+
+PageLayout::PageLayout()
+    : m_firstPage(0)
+    , m_scale(1.0)
+    , m_spacing(0)
+{
+}
+
+void PageLayout::setPages(const QList<QSizeF>& pageSizes, int firstPage)
+{
+    m_pageSizes = pageSizes;
+    m_firstPage = firstPage;
+    rebuild();
+}
+
+void PageLayout::setScale(double pixelsPerPoint, int spacing)
+{
+    m_scale = pixelsPerPoint;
+    m_spacing = spacing;
+    rebuild();
+}
+
+void PageLayout::clear()
+{
+    m_pageSizes.clear();
+    m_firstPage = 0;
+    rebuild();
+}
+
+bool PageLayout::isEmpty() const
+{
+    return m_tops.empty();
+}
+
+int PageLayout::firstPage() const
+{
+    return m_firstPage;
+}
+
+int PageLayout::lastPage() const
+{
+    return m_firstPage + static_cast<int>(m_tops.size()) - 1;
+}
+
+bool PageLayout::contains(int pageIndex) const
+{
+    return pageIndex >= m_firstPage && pageIndex <= lastPage();
+}
+
+QSize PageLayout::size() const
+{
+    return m_size;
+}
+
+QRect PageLayout::pageRect(int pageIndex) const
+{
+    if (!contains(pageIndex)) {
+        return QRect();
+    }
+    
+    int i = pageIndex - m_firstPage;
+    const QSize& size = m_pixelSizes[i];
+    return QRect((m_size.width() - size.width()) / 2, m_tops[i], size.width(), size.height());
+}
+
+int PageLayout::pageAt(int y) const
+{
+    if (m_tops.empty()) {
+        return -1;
+    }
+    
+    auto it = std::upper_bound(m_tops.begin(), m_tops.end(), y);
+    int i = static_cast<int>(it - m_tops.begin()) - 1;
+    return m_firstPage + std::clamp(i, 0, static_cast<int>(m_tops.size()) - 1);
+}
+
+void PageLayout::rebuild()
+{
+    m_tops.clear();
+    m_pixelSizes.clear();
+    m_size = QSize();
+    
+    if (m_pageSizes.isEmpty()) {
+        return;
+    }
+    
+    m_tops.reserve(m_pageSizes.size());
+    m_pixelSizes.reserve(m_pageSizes.size());
+    
+    // Prefix sums of page heights; 64-bit while summing so that huge
+    // documents at high zoom clamp instead of wrapping
+    qint64 y = m_spacing;
+    int maxWidth = 0;
+    for (const QSizeF& pageSize : m_pageSizes) {
+        QSize pixels(static_cast<int>(std::ceil(pageSize.width() * m_scale)),
+                     static_cast<int>(std::ceil(pageSize.height() * m_scale)));
+        m_tops.push_back(static_cast<int>(std::min<qint64>(y, INT_MAX)));
+        m_pixelSizes.push_back(pixels);
+        maxWidth = std::max(maxWidth, pixels.width());
+        y += pixels.height() + m_spacing;
+    }
+    
+    m_size = QSize(maxWidth + 2 * m_spacing, static_cast<int>(std::min<qint64>(y, INT_MAX)));
+}
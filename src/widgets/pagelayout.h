@@ -0,0 +1,70 @@
+#pragma once
+
+#include <QList>
+#include <QSize>
+#include <QSizeF>
+#include <QRect>
+#include <vector>
+
+/**
+ * Vertical stack of pages used by DocumentViewer.
+ * Page tops are kept as prefix sums of the scaled page heights, so the page
+ * at any scroll position is found by binary search and no per-page widget or
+ * bitmap is needed to lay out a document.
+ * The layout can cover the whole document or a single page.
+ */
+class PageLayout
+{
+public:
+    PageLayout();
+    
+    /**
+     * Set the pages to lay out.
+     * @param pageSizes Page sizes in points, in page order
+     * @param firstPage Document index of the first entry in pageSizes
+     */
+    void setPages(const QList<QSizeF>& pageSizes, int firstPage = 0);
+    
+    /**
+     * Set the scale and the gap between pages and recompute positions.
+     * @param pixelsPerPoint Scale from page points to layout pixels
+     * @param spacing Gap around every page in pixels
+     */
+    void setScale(double pixelsPerPoint, int spacing);
+    
+    void clear();
+    bool isEmpty() const;
+    
+    int firstPage() const;
+    int lastPage() const;
+    bool contains(int pageIndex) const;
+    
+    /**
+     * Size of the whole layout in pixels.
+     */
+    QSize size() const;
+    
+    /**
+     * Rectangle of a page in layout coordinates. Pages narrower than the
+     * widest page are centred horizontally.
+     */
+    QRect pageRect(int pageIndex) const;
+    
+    /**
+     * Page under a layout y coordinate, clamped to the laid out pages.
+     * Gaps belong to the page above them. O(log n).
+     */
+    int pageAt(int y) const;
+    
+private:
+    void rebuild();
+    
+    QList<QSizeF> m_pageSizes;
+    int m_firstPage;
+    double m_scale;
+    int m_spacing;
+    
+    std::vector<int> m_tops; // Top edge of each page
+    std::vector<QSize> m_pixelSizes;
+    QSize m_size;
+};
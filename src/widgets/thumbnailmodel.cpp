@@ -0,0 +1,224 @@
+#include "thumbnailmodel.h"
+#include "../document/documentreader.h"
+#include "../document/renderqueue.h"
+#include "../config.h"
+#include <QCoreApplication>
+#include <QPointer>
+#include <QRunnable>
+#include <QThreadPool>
+#include <algorithm>
+
+ThumbnailModel::ThumbnailModel(QObject* parent)
+    : QAbstractListModel(parent)
+    , m_document(nullptr)
+    , m_pageCount(0)
+    , m_renderQueue(nullptr)
+    , m_cache(static_cast<qint64>(THUMBNAIL_CACHE_MB) * 1024 * 1024)
+    , m_storeGeneration(0)
+    , m_placeholder(THUMBNAIL_WIDTH, THUMBNAIL_HEIGHT)
+{
+    m_placeholder.fill(Qt::darkGray);
+
+    m_renderQueue = new RenderQueue(this);
+    m_renderQueue->setMaxThreadCount(WORKER_THREADS);
+    connect(m_renderQueue, &RenderQueue::rendered, this, &ThumbnailModel::onThumbnailRendered);
+}
+
+ThumbnailModel::~ThumbnailModel()
+{
+    m_renderQueue->cancelAll();
+    m_renderQueue->waitForDone();
+}
+
+void ThumbnailModel::setDocument(DocumentReader* document)
+{
+    beginResetModel();
+
+    // Workers must be done with the previous document before the caller
+    // is allowed to destroy it
+    m_renderQueue->cancelAll();
+    m_renderQueue->waitForDone();
+    m_cache.clear();
+    m_failed.clear();
+    m_store.reset();
+    ++m_storeGeneration;
+
+    m_document = document;
+    m_pageCount = m_document && m_document->isLoaded() ? m_document->pageCount() : 0;
+    if (m_pageCount > 0) {
+        // Fingerprinting reads the document, so the store is opened on a
+        // worker. The result is posted through the application object and
+        // dropped if this model or its document has gone by then.
+        auto store = std::make_shared<ThumbnailStore>();
+        QString filePath = m_document->filePath();
+        std::shared_ptr<const MappedFile> file = m_document->mappedFile();
+        int pageCount = m_pageCount;
+        QSize size = thumbnailSize();
+        QPointer<ThumbnailModel> model(this);
+        quint64 generation = m_storeGeneration;
+        QThreadPool::globalInstance()->start(QRunnable::create([store, filePath, pageCount, size, file, model, generation]() {
+            store->open(filePath, pageCount, size, file);
+            QMetaObject::invokeMethod(QCoreApplication::instance(), [model, generation, store]() {
+                if (model) {
+                    model->onStoreOpened(generation, store);
+                }
+            }, Qt::QueuedConnection);
+        }));
+    }
+
+    endResetModel();
+}
+
+void ThumbnailModel::onStoreOpened(quint64 generation, const std::shared_ptr<ThumbnailStore>& store)
+{
+    if (generation != m_storeGeneration) {
+        return; // Opened for a document that has been replaced
+    }
+
+    // A store that failed to open still lets rendering start; it just
+    // holds nothing
+    m_store = store;
+    if (m_pageCount > 0) {
+        emit dataChanged(index(0), index(m_pageCount - 1), {Qt::DecorationRole});
+    }
+}
+
+QSize ThumbnailModel::thumbnailSize() const
+{
+    return QSize(THUMBNAIL_WIDTH, THUMBNAIL_HEIGHT);
+}
+
+QPixmap ThumbnailModel::thumbnail(int pageIndex) const
+{
+    if (!m_document || pageIndex < 0 || pageIndex >= m_pageCount) {
+        return QPixmap();
+    }
+
+    RenderKey key = keyFor(pageIndex);
+    QPixmap pixmap = m_cache.peek(key);
+    if (pixmap.isNull() && m_store && m_store->contains(pageIndex)) {
+        pixmap = QPixmap::fromImage(m_store->load(pageIndex));
+        if (!pixmap.isNull()) {
+            m_cache.insert(key, pixmap);
+        }
+    }
+    return pixmap;
+}
+
+void ThumbnailModel::setVisibleRange(int first, int last)
+{
+    if (!m_document || m_pageCount == 0 || first < 0 || last < first) {
+        return;
+    }
+
+    int low = std::max(0, first - PREFETCH_ROWS);
+    int high = std::min(m_pageCount - 1, last + PREFETCH_ROWS);
+
+    // The user scrolled past these; rendering them would only delay the
+    // rows that are on screen now
+    m_renderQueue->cancelIf([low, high](const RenderKey& key) {
+        return key.pageIndex < low || key.pageIndex > high;
+    });
+
+    for (int page = first; page <= std::min(last, m_pageCount - 1); ++page) {
+        requestThumbnail(page, RenderQueue::VisiblePriority);
+    }
+
+    // Then outward from the visible rows in both directions
+    for (int distance = 1; distance <= PREFETCH_ROWS; ++distance) {
+        if (last + distance <= high) {
+            requestThumbnail(last + distance, RenderQueue::PrefetchPriority);
+        }
+        if (first - distance >= low) {
+            requestThumbnail(first - distance, RenderQueue::PrefetchPriority);
+        }
+    }
+}
+
+int ThumbnailModel::rowCount(const QModelIndex& parent) const
+{
+    return parent.isValid() ? 0 : m_pageCount;
+}
+
+QVariant ThumbnailModel::data(const QModelIndex& index, int role) const
+{
+    if (!index.isValid() || index.row() >= m_pageCount) {
+        return QVariant();
+    }
+
+    int pageIndex = index.row();
+    switch (role) {
+    case Qt::DisplayRole:
+        return QString::number(pageIndex + 1); // 1-based page number for display
+    case Qt::ToolTipRole:
+        return QString("Page %1").arg(pageIndex + 1);
+    case Qt::UserRole:
+        return pageIndex;
+    case Qt::DecorationRole: {
+        // Views only ask for rows they paint, so this is what makes
+        // rendering follow the scroll position
+        RenderKey key = keyFor(pageIndex);
+        QPixmap pixmap = m_cache.find(key);
+        if (!pixmap.isNull()) {
+            return pixmap;
+        }
+        if (m_store && m_store->contains(pageIndex)) {
+            pixmap = QPixmap::fromImage(m_store->load(pageIndex));
+            if (!pixmap.isNull()) {
+                m_cache.insert(key, pixmap);
+                return pixmap;
+            }
+        }
+        requestThumbnail(pageIndex, RenderQueue::VisiblePriority);
+        return m_placeholder;
+    }
+    default:
+        return QVariant();
+    }
+}
+
+void ThumbnailModel::onThumbnailRendered(const RenderKey& key, const QImage& image)
+{
+    if (key.document != m_document || key.pageIndex >= m_pageCount) {
+        return;
+    }
+
+    if (image.isNull()) {
+        // Keep the placeholder instead of retrying on every repaint
+        m_failed.insert(key.pageIndex);
+        return;
+    }
+
+    // Already rendered at thumbnail size, no scaling pass needed, and
+    // saved to the store by the worker
+    m_cache.insert(key, QPixmap::fromImage(image));
+
+    QModelIndex row = index(key.pageIndex);
+    emit dataChanged(row, row, {Qt::DecorationRole});
+}
+
+RenderKey ThumbnailModel::keyFor(int pageIndex) const
+{
+    // Thumbnails are rendered to fit a box rather than at a DPI; the DPI
+    // only tells thumbnail keys apart from page renders
+    return RenderKey(m_document, pageIndex, THUMBNAIL_DPI, m_document ? m_document->renderHints() : 0);
+}
+
+void ThumbnailModel::requestThumbnail(int pageIndex, int priority) const
+{
+    // Until the store is open it is unknown which pages are on disk
+    RenderKey key = keyFor(pageIndex);
+    if (!m_store || m_failed.contains(pageIndex) || m_cache.contains(key) || m_store->contains(pageIndex)) {
+        return;
+    }
+
+    // Encoded and written by the worker too, off the GUI thread
+    DocumentReader* document = m_document;
+    std::shared_ptr<ThumbnailStore> store = m_store;
+    QSize box = thumbnailSize();
+    m_renderQueue->request(key, priority, [document, store, pageIndex, box](const std::atomic_bool* cancelled) {
+        QImage image = document->renderThumbnail(pageIndex, box, cancelled);
+        store->save(pageIndex, image);
+        return image;
+    });
+}
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <QAbstractListModel>
+#include <QPixmap>
+#include <QSet>
+#include <QSize>
+#include <memory>
+#include "../document/rendercache.h"
+#include "../document/thumbnailstore.h"
+
+class DocumentReader;
+class RenderQueue;
+
+/**
+ * List model with one row per document page, whose decoration is the page
+ * thumbnail.
+ * Thumbnails are rendered on background workers only when a view asks for a
+ * row or announces the rows it is about to show; until then a placeholder
+ * is returned. Rendered thumbnails are kept in a bounded cache, so a long
+ * document never holds all of its thumbnails at once, and are written to a
+ * ThumbnailStore on disk, so reopening a document does not render them again.
+ * The store is opened and written on worker threads; nothing is rendered
+ * until it is open, so thumbnails already on disk are never rendered again.
+ */
+class ThumbnailModel : public QAbstractListModel
+{
+    Q_OBJECT
+
+public:
+    explicit ThumbnailModel(QObject* parent = nullptr);
+    ~ThumbnailModel() override;
+
+    /**
+     * Set the document to provide thumbnails for.
+     * @param document Pointer to the document reader, or nullptr to clear
+     */
+    void setDocument(DocumentReader* document);
+
+    /**
+     * Get the box every thumbnail is fitted into.
+     */
+    QSize thumbnailSize() const;
+
+    /**
+     * Get the thumbnail of a page if it has been rendered, now or in an
+     * earlier session. Does not queue a render.
+     * @param pageIndex 0-based page index
+     * @return Thumbnail pixmap, or null pixmap if not available yet
+     */
+    QPixmap thumbnail(int pageIndex) const;
+
+    /**
+     * Tell the model which rows are on screen. Thumbnails for these rows and
+     * a margin around them are rendered, nearest first; queued work outside
+     * the margin is dropped.
+     * @param first First visible row
+     * @param last Last visible row
+     */
+    void setVisibleRange(int first, int last);
+
+    int rowCount(const QModelIndex& parent = QModelIndex()) const override;
+    QVariant data(const QModelIndex& index, int role = Qt::DisplayRole) const override;
+
+private slots:
+    void onThumbnailRendered(const RenderKey& key, const QImage& image);
+
+private:
+    void onStoreOpened(quint64 generation, const std::shared_ptr<ThumbnailStore>& store);
+    RenderKey keyFor(int pageIndex) const;
+    void requestThumbnail(int pageIndex, int priority) const;
+
+    DocumentReader* m_document;
+    int m_pageCount;
+    RenderQueue* m_renderQueue;
+    mutable RenderCache m_cache; // Lookups from data() refresh the LRU order
+    std::shared_ptr<ThumbnailStore> m_store; // Null while it is being opened
+    quint64 m_storeGeneration;   // Tells the current document's store from earlier ones
+    QSet<int> m_failed;          // Pages that could not be rendered
+    QPixmap m_placeholder;
+
+    static constexpr int PREFETCH_ROWS = 20;     // Rendered beyond each end of the visible range
+    static constexpr int WORKER_THREADS = 2;     // Leaves the viewer's renders room on the document
+};
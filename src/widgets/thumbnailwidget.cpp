@@ -1,18 +1,18 @@
 #include "thumbnailwidget.h"
+#include "thumbnailmodel.h"
 #include "../document/documentreader.h"
 #include <QVBoxLayout>
-#include <QListWidget>
+#include <QListView>
 #include <QLabel>
-#include <QListWidgetItem>
 #include <QPixmap>
-#include <QApplication>
-#include <QProgressDialog>
+#include <QScrollBar>
 #include <QTimer>
 
 ThumbnailWidget::ThumbnailWidget(QWidget *parent)
     : QWidget(parent)
     , m_document(nullptr)
-    , m_listWidget(nullptr)
+    , m_model(nullptr)
+    , m_listView(nullptr)
     , m_statusLabel(nullptr)
 {
     setMinimumWidth(150);
@@ -27,38 +27,44 @@ ThumbnailWidget::ThumbnailWidget(QWidget *parent)
     m_statusLabel->setStyleSheet("QLabel { color: #888; font-style: italic; }");
     layout->addWidget(m_statusLabel);
     
-    // Thumbnail list
-    m_listWidget = new QListWidget(this);
-    m_listWidget->setViewMode(QListWidget::IconMode);
-    m_listWidget->setIconSize(QSize(THUMBNAIL_WIDTH, THUMBNAIL_WIDTH * 1.4)); // Approximate page ratio
-    m_listWidget->setResizeMode(QListWidget::Adjust);
-    m_listWidget->setUniformItemSizes(true);
-    m_listWidget->setSpacing(5);
-    m_listWidget->setStyleSheet(
-        "QListWidget {"
+    // Thumbnail list; uniform item sizes let the view lay out thousands of
+    // rows without asking the model for anything but the visible ones
+    m_model = new ThumbnailModel(this);
+    m_listView = new QListView(this);
+    m_listView->setModel(m_model);
+    m_listView->setViewMode(QListView::IconMode);
+    m_listView->setIconSize(m_model->thumbnailSize());
+    m_listView->setResizeMode(QListView::Adjust);
+    m_listView->setMovement(QListView::Static);
+    m_listView->setUniformItemSizes(true);
+    m_listView->setSpacing(5);
+    m_listView->setStyleSheet(
+        "QListView {"
         "    background-color: transparent;"
         "    border: none;"
         "}"
-        "QListWidget::item {"
+        "QListView::item {"
         "    background-color: #3a3a3a;"
         "    border: 2px solid transparent;"
         "    border-radius: 4px;"
         "    margin: 2px;"
         "}"
-        "QListWidget::item:selected {"
+        "QListView::item:selected {"
         "    background-color: #4a4a4a;"
         "    border-color: #42A5F5;"
         "}"
-        "QListWidget::item:hover {"
+        "QListView::item:hover {"
         "    background-color: #4a4a4a;"
         "    border-color: #666;"
         "}"
     );
     
-    layout->addWidget(m_listWidget);
+    layout->addWidget(m_listView);
     
     // Connect signals
-    connect(m_listWidget, &QListWidget::itemClicked, this, &ThumbnailWidget::onItemClicked);
+    connect(m_listView, &QListView::clicked, this, &ThumbnailWidget::onItemClicked);
+    connect(m_listView->verticalScrollBar(), &QScrollBar::valueChanged, this, &ThumbnailWidget::updateVisibleRange);
+    connect(m_listView->verticalScrollBar(), &QScrollBar::rangeChanged, this, &ThumbnailWidget::updateVisibleRange);
 }
 
 ThumbnailWidget::~ThumbnailWidget() = default;
@@ -66,13 +72,13 @@ ThumbnailWidget::~ThumbnailWidget() = default;
 void ThumbnailWidget::setDocument(DocumentReader* document)
 {
     m_document = document;
-    clearThumbnails();
+    m_model->setDocument(document);
     
     if (m_document && m_document->isLoaded()) {
         m_statusLabel->setText(QString("Pages: %1").arg(m_document->pageCount()));
         
-        // Generate thumbnails asynchronously
-        QTimer::singleShot(100, this, &ThumbnailWidget::generateThumbnails);
+        // Rows are laid out once the view has processed the reset
+        QTimer::singleShot(0, this, &ThumbnailWidget::updateVisibleRange);
     } else {
         m_statusLabel->setText("No document");
     }
@@ -80,92 +86,39 @@ void ThumbnailWidget::setDocument(DocumentReader* document)
 
 void ThumbnailWidget::setCurrentPage(int pageIndex)
 {
-    if (pageIndex >= 0 && pageIndex < m_listWidget->count()) {
-        m_listWidget->setCurrentRow(pageIndex);
+    if (pageIndex >= 0 && pageIndex < m_model->rowCount()) {
+        m_listView->setCurrentIndex(m_model->index(pageIndex));
     }
 }
 
-void ThumbnailWidget::onItemClicked(QListWidgetItem* item)
+QPixmap ThumbnailWidget::thumbnail(int pageIndex) const
 {
-    if (!item) {
-        return;
-    }
-    
-    int pageIndex = item->data(Qt::UserRole).toInt();
-    emit pageRequested(pageIndex);
+    return m_model->thumbnail(pageIndex);
 }
 
-void ThumbnailWidget::generateThumbnails()
+void ThumbnailWidget::onItemClicked(const QModelIndex& index)
 {
-    if (!m_document || !m_document->isLoaded()) {
+    if (!index.isValid()) {
         return;
     }
     
-    int pageCount = m_document->pageCount();
-    
-    // Show progress for large documents
-    QProgressDialog* progress = nullptr;
-    if (pageCount > 20) {
-        progress = new QProgressDialog("Generating thumbnails...", "Cancel", 0, pageCount, this);
-        progress->setWindowModality(Qt::WindowModal);
-        progress->show();
-    }
-    
-    for (int i = 0; i < pageCount; ++i) {
-        if (progress && progress->wasCanceled()) {
-            break;
-        }
-        
-        if (progress) {
-            progress->setValue(i);
-            QApplication::processEvents();
-        }
-        
-        QPixmap thumbnail = generateThumbnail(i);
-        
-        QListWidgetItem* item = new QListWidgetItem;
-        item->setIcon(QIcon(thumbnail));
-        item->setText(QString::number(i + 1)); // 1-based page number for display
-        item->setData(Qt::UserRole, i); // Store 0-based page index
-        item->setToolTip(QString("Page %1").arg(i + 1));
-        
-        m_listWidget->addItem(item);
-    }
-    
-    if (progress) {
-        progress->setValue(pageCount);
-        progress->deleteLater();
-    }
-}
-
-void ThumbnailWidget::clearThumbnails()
-{
-    m_listWidget->clear();
+    int pageIndex = index.data(Qt::UserRole).toInt();
+    emit pageRequested(pageIndex);
 }
 
-QPixmap ThumbnailWidget::generateThumbnail(int pageIndex)
+void ThumbnailWidget::updateVisibleRange()
 {
-    if (!m_document || !m_document->isLoaded()) {
-        return QPixmap();
-    }
-    
-    // Render page at low DPI for thumbnail
-    QPixmap pagePixmap = m_document->renderPage(pageIndex, THUMBNAIL_DPI);
-    
-    if (pagePixmap.isNull()) {
-        // Create a placeholder thumbnail
-        QPixmap placeholder(THUMBNAIL_WIDTH, THUMBNAIL_WIDTH * 1.4);
-        placeholder.fill(Qt::darkGray);
-        return placeholder;
+    if (m_model->rowCount() == 0) {
+        return;
     }
     
-    // Scale to thumbnail size while maintaining aspect ratio
-    QPixmap thumbnail = pagePixmap.scaled(
-        THUMBNAIL_WIDTH, 
-        THUMBNAIL_WIDTH * 1.4, 
-        Qt::KeepAspectRatio, 
-        Qt::SmoothTransformation
-    );
+    // Rows at the top and bottom edge of the viewport; with one column of
+    // uniform items everything in between is visible
+    QRect area = m_listView->viewport()->rect();
+    QModelIndex first = m_listView->indexAt(area.topLeft() + QPoint(area.width() / 2, 1));
+    QModelIndex last = m_listView->indexAt(area.bottomLeft() + QPoint(area.width() / 2, -1));
     
-    return thumbnail;
+    int firstRow = first.isValid() ? first.row() : 0;
+    int lastRow = last.isValid() ? last.row() : m_model->rowCount() - 1;
+    m_model->setVisibleRange(firstRow, lastRow);
 }
@@ -1,17 +1,20 @@
 #pragma once
 
 #include <QWidget>
-#include <QListWidget>
+#include <QListView>
 #include <QVBoxLayout>
 #include <QLabel>
 #include <QPixmap>
-#include <QListWidgetItem>
+#include <QModelIndex>
 
 class DocumentReader;
+class ThumbnailModel;
 
 /**
  * Widget for displaying document page thumbnails.
  * Provides a sidebar with clickable thumbnail previews of all pages.
+ * Only the thumbnails of pages scrolled into view are rendered, in the
+ * background, with placeholders shown until they arrive.
  */
 class ThumbnailWidget : public QWidget
 {
@@ -32,22 +35,24 @@ public:
      * @param pageIndex 0-based page index
      */
     void setCurrentPage(int pageIndex);
+    
+    /**
+     * Get the thumbnail of a page if it has been generated.
+     * @param pageIndex 0-based page index
+     * @return Thumbnail pixmap, or null pixmap if not available yet
+     */
+    QPixmap thumbnail(int pageIndex) const;
 
 signals:
     void pageRequested(int pageIndex);
 
 private slots:
-    void onItemClicked(QListWidgetItem* item);
-    void generateThumbnails();
+    void onItemClicked(const QModelIndex& index);
+    void updateVisibleRange();
 
 private:
-    void clearThumbnails();
-    QPixmap generateThumbnail(int pageIndex);
-    
     DocumentReader* m_document;
-    QListWidget* m_listWidget;
+    ThumbnailModel* m_model;
+    QListView* m_listView;
     QLabel* m_statusLabel;
-    
-    static constexpr int THUMBNAIL_WIDTH = 120;
-    static constexpr int THUMBNAIL_DPI = 36; // Low DPI for fast thumbnail generation
 };
@@ -0,0 +1,251 @@
+// Checks the single-pass searches of DocumentReader, searchTerms() and
+// searchRegularExpressions(), against searching each page for each term.
+
+#include "document/documentreader.h"
+#include <QList>
+#include <QRandomGenerator>
+#include <QRegularExpression>
+#include <QString>
+#include <QStringList>
+#include <QTest>
+
+namespace {
+
+// A document of text pages held in memory, which searches with the
+// default implementations of DocumentReader
+class TextDocument : public DocumentReader
+{
+public:
+    explicit TextDocument(const QStringList& pages)
+        : m_pages(pages)
+        , m_loaded(true)
+    {
+    }
+
+    bool load(const QString& filePath) override
+    {
+        Q_UNUSED(filePath);
+        m_loaded = true;
+        return true;
+    }
+    void close() override { m_loaded = false; }
+    bool isLoaded() const override { return m_loaded; }
+    int pageCount() const override { return m_loaded ? static_cast<int>(m_pages.size()) : 0; }
+
+    QPixmap renderPage(int pageIndex, double dpi) const override
+    {
+        Q_UNUSED(pageIndex);
+        Q_UNUSED(dpi);
+        return QPixmap();
+    }
+    QImage renderImage(int pageIndex, double dpi, const QRect& region,
+                       const std::atomic_bool* cancelled) const override
+    {
+        Q_UNUSED(pageIndex);
+        Q_UNUSED(dpi);
+        Q_UNUSED(region);
+        Q_UNUSED(cancelled);
+        return QImage();
+    }
+    QSizeF pageSize(int pageIndex) const override
+    {
+        Q_UNUSED(pageIndex);
+        return QSizeF(612, 792);
+    }
+
+    QString title() const override { return QString(); }
+    QString author() const override { return QString(); }
+    QString subject() const override { return QString(); }
+    QString creator() const override { return QString(); }
+    QString producer() const override { return QString(); }
+    QString filePath() const override { return QString(); }
+
+    bool supportsTextExtraction() const override { return true; }
+    QString extractText(int pageIndex) const override { return m_pages.value(pageIndex); }
+
+    QList<int> searchText(const QString& searchText, bool caseSensitive) const override
+    {
+        QList<int> results;
+        for (int i = 0; i < pageCount(); ++i) {
+            if (m_pages[i].contains(searchText, caseSensitive ? Qt::CaseSensitive : Qt::CaseInsensitive)) {
+                results.append(i);
+            }
+        }
+        return results;
+    }
+
+private:
+    QStringList m_pages;
+    bool m_loaded;
+};
+
+} // namespace
+
+class DocumentSearchTest : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void testSearchTerms_data();
+    void testSearchTerms();
+    void testSearchTermsRandom();
+    void testSearchRegularExpressions();
+    void testInvalidRegularExpression();
+    void testNotLoaded();
+    void testNoTerms();
+
+private:
+    static QList<QList<int>> bruteForceTerms(const QStringList& pages, const QStringList& terms, bool caseSensitive);
+};
+
+QList<QList<int>> DocumentSearchTest::bruteForceTerms(const QStringList& pages, const QStringList& terms,
+                                                      bool caseSensitive)
+{
+    QList<QList<int>> results;
+    for (const QString& term : terms) {
+        QList<int> found;
+        for (int i = 0; i < pages.size(); ++i) {
+            // An empty term finds nothing rather than every page
+            if (!term.isEmpty() && pages[i].contains(term, caseSensitive ? Qt::CaseSensitive : Qt::CaseInsensitive)) {
+                found.append(i);
+            }
+        }
+        results.append(found);
+    }
+    return results;
+}
+
+void DocumentSearchTest::testSearchTerms_data()
+{
+    QTest::addColumn<QStringList>("pages");
+    QTest::addColumn<QStringList>("terms");
+    QTest::addColumn<bool>("caseSensitive");
+
+    const QStringList pages = {
+        "The quick brown fox",
+        "jumps over the lazy dog",
+        "",
+        "THE END",
+        QString::fromUtf8("Grüße aus Köln, ΣΟΦΙΑ")
+    };
+
+    QTest::newRow("one term") << pages << QStringList{"the"} << false;
+    QTest::newRow("one term, case sensitive") << pages << QStringList{"the"} << true;
+    QTest::newRow("several terms") << pages << QStringList{"fox", "dog", "cat", "o"} << false;
+    QTest::newRow("overlapping terms") << pages << QStringList{"the", "he", "the end", "end"} << false;
+    QTest::newRow("overlapping terms, case sensitive") << pages << QStringList{"the", "he", "THE", "END"} << true;
+    QTest::newRow("empty and duplicate terms") << pages << QStringList{"", "quick", "quick"} << false;
+    QTest::newRow("folded") << pages << QStringList{QString::fromUtf8("KÖLN"), QString::fromUtf8("σοφια")} << false;
+    QTest::newRow("folded, case sensitive")
+        << pages << QStringList{QString::fromUtf8("KÖLN"), QString::fromUtf8("Köln")} << true;
+}
+
+void DocumentSearchTest::testSearchTerms()
+{
+    QFETCH(QStringList, pages);
+    QFETCH(QStringList, terms);
+    QFETCH(bool, caseSensitive);
+
+    TextDocument document(pages);
+    QCOMPARE(document.searchTerms(terms, caseSensitive), bruteForceTerms(pages, terms, caseSensitive));
+
+    // The same pages as searching for the terms one at a time
+    QList<QList<int>> results = document.searchTerms(terms, caseSensitive);
+    for (int i = 0; i < terms.size(); ++i) {
+        if (!terms[i].isEmpty()) {
+            QCOMPARE(results[i], document.searchText(terms[i], caseSensitive));
+        }
+    }
+}
+
+void DocumentSearchTest::testSearchTermsRandom()
+{
+    const QString alphabet = "abAB ";
+    QRandomGenerator random(20261017);
+    auto randomText = [&random, &alphabet](int size) {
+        QString text;
+        for (int i = 0; i < size; ++i) {
+            text.append(alphabet[random.bounded(static_cast<int>(alphabet.size()))]);
+        }
+        return text;
+    };
+
+    for (int round = 0; round < 200; ++round) {
+        QStringList pages;
+        for (int i = random.bounded(0, 6); i > 0; --i) {
+            pages.append(randomText(random.bounded(0, 40)));
+        }
+        QStringList terms;
+        for (int i = random.bounded(1, 8); i > 0; --i) {
+            terms.append(randomText(random.bounded(0, 5)));
+        }
+
+        TextDocument document(pages);
+        for (bool caseSensitive : {false, true}) {
+            QVERIFY2(document.searchTerms(terms, caseSensitive) == bruteForceTerms(pages, terms, caseSensitive),
+                     qPrintable(QStringLiteral("terms \"%1\" in pages \"%2\"")
+                                    .arg(terms.join("\", \""), pages.join("\", \""))));
+        }
+    }
+}
+
+void DocumentSearchTest::testSearchRegularExpressions()
+{
+    const QStringList pages = {"Invoice 2024-001", "no numbers here", "Total: 42 EUR", "", "invoice 7"};
+    TextDocument document(pages);
+
+    QList<QRegularExpression> expressions = {
+        QRegularExpression("\\d+"),
+        QRegularExpression("^invoice", QRegularExpression::CaseInsensitiveOption),
+        QRegularExpression("^invoice"),
+        QRegularExpression("\\bEUR\\b"),
+        QRegularExpression("absent")
+    };
+    QList<QList<int>> expected = {{0, 2, 4}, {0, 4}, {4}, {2}, {}};
+    QCOMPARE(document.searchRegularExpressions(expressions), expected);
+
+    // Each expression finds what matching every page with it finds
+    QList<QList<int>> results = document.searchRegularExpressions(expressions);
+    for (int e = 0; e < expressions.size(); ++e) {
+        QList<int> found;
+        for (int i = 0; i < pages.size(); ++i) {
+            if (expressions[e].match(pages[i]).hasMatch()) {
+                found.append(i);
+            }
+        }
+        QCOMPARE(results[e], found);
+    }
+}
+
+void DocumentSearchTest::testInvalidRegularExpression()
+{
+    TextDocument document({"a(b", "abc"});
+
+    QList<QRegularExpression> expressions = {QRegularExpression("a("), QRegularExpression("b")};
+    QVERIFY(!expressions[0].isValid());
+    QList<QList<int>> expected = {{}, {0, 1}};
+    QCOMPARE(document.searchRegularExpressions(expressions), expected);
+}
+
+void DocumentSearchTest::testNotLoaded()
+{
+    TextDocument document({"abc", "abc"});
+    document.close();
+
+    // One empty list per term, so results still line up with the terms
+    QStringList terms = {"a", "b"};
+    QList<QList<int>> noPages = {{}, {}};
+    QCOMPARE(document.searchTerms(terms), noPages);
+    QList<QRegularExpression> expressions = {QRegularExpression("a")};
+    QCOMPARE(document.searchRegularExpressions(expressions), QList<QList<int>>(1));
+}
+
+void DocumentSearchTest::testNoTerms()
+{
+    TextDocument document({"abc"});
+    QVERIFY(document.searchTerms(QStringList()).isEmpty());
+    QVERIFY(document.searchRegularExpressions(QList<QRegularExpression>()).isEmpty());
+}
+
+QTEST_APPLESS_MAIN(DocumentSearchTest)
+#include "documentsearchtest.moc"
@@ -0,0 +1,122 @@
+// Checks MultiPatternMatcher against QString::contains() run once per
+// pattern.
+
+#include "document/multipatternmatcher.h"
+#include <QList>
+#include <QRandomGenerator>
+#include <QString>
+#include <QStringList>
+#include <QTest>
+
+class MultiPatternMatcherTest : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void testFindIn_data();
+    void testFindIn();
+    void testRandomTexts();
+    void testPatternCount();
+
+private:
+    static QList<int> bruteForce(const QStringList& patterns, const QString& text);
+    static QString randomText(QRandomGenerator& random, const QString& alphabet, int size);
+};
+
+QList<int> MultiPatternMatcherTest::bruteForce(const QStringList& patterns, const QString& text)
+{
+    QList<int> found;
+    for (int i = 0; i < patterns.size(); ++i) {
+        // Empty patterns never match, unlike QString::contains()
+        if (!patterns[i].isEmpty() && text.contains(patterns[i])) {
+            found.append(i);
+        }
+    }
+    return found;
+}
+
+QString MultiPatternMatcherTest::randomText(QRandomGenerator& random, const QString& alphabet, int size)
+{
+    QString text;
+    text.reserve(size);
+    for (int i = 0; i < size; ++i) {
+        text.append(alphabet[random.bounded(static_cast<int>(alphabet.size()))]);
+    }
+    return text;
+}
+
+void MultiPatternMatcherTest::testFindIn_data()
+{
+    QTest::addColumn<QStringList>("patterns");
+    QTest::addColumn<QString>("text");
+    QTest::addColumn<QList<int>>("expected");
+
+    QTest::newRow("none") << QStringList() << "anything" << QList<int>();
+    QTest::newRow("empty text") << QStringList{"a"} << "" << QList<int>();
+    QTest::newRow("single") << QStringList{"fox"} << "the quick brown fox" << QList<int>{0};
+    QTest::newRow("absent") << QStringList{"dog"} << "the quick brown fox" << QList<int>();
+    // The classic example: patterns that overlap and end inside each other
+    QTest::newRow("overlapping") << QStringList{"he", "she", "his", "hers"} << "ushers" << QList<int>{0, 1, 3};
+    // Found only by following the suffix link from a longer partial match
+    QTest::newRow("suffix") << QStringList{"abcd", "bc"} << "abcx" << QList<int>{1};
+    QTest::newRow("pattern inside pattern") << QStringList{"abc", "b"} << "xbx" << QList<int>{1};
+    QTest::newRow("ascending order") << QStringList{"z", "y", "x"} << "xyz" << QList<int>{0, 1, 2};
+    QTest::newRow("empty pattern") << QStringList{"", "a"} << "a" << QList<int>{1};
+    QTest::newRow("only empty patterns") << QStringList{"", ""} << "abc" << QList<int>();
+    QTest::newRow("duplicates") << QStringList{"ab", "ab", "c"} << "xabx" << QList<int>{0, 1};
+    QTest::newRow("whole text") << QStringList{"abc"} << "abc" << QList<int>{0};
+    QTest::newRow("longer than text") << QStringList{"abcd"} << "abc" << QList<int>();
+    QTest::newRow("repeated units") << QStringList{"aaa", "aab"} << "aaaab" << QList<int>{0, 1};
+    QTest::newRow("non-latin")
+        << QStringList{QString::fromUtf8("мир"), QString::fromUtf8("λόγος"), QString::fromUtf8("война")}
+        << QString::fromUtf8("Война и мир") << QList<int>{0};
+    QTest::newRow("surrogate pairs")
+        << QStringList{QString::fromUtf16(u"\U0001F600"), QString::fromUtf16(u"\U0001F601")}
+        << QString::fromUtf16(u"a\U0001F600b") << QList<int>{0};
+}
+
+void MultiPatternMatcherTest::testFindIn()
+{
+    QFETCH(QStringList, patterns);
+    QFETCH(QString, text);
+    QFETCH(QList<int>, expected);
+
+    MultiPatternMatcher matcher(patterns);
+    QCOMPARE(matcher.findIn(text), expected);
+    QCOMPARE(bruteForce(patterns, text), expected);
+}
+
+void MultiPatternMatcherTest::testRandomTexts()
+{
+    // Small alphabets give many shared prefixes and suffixes, so failure
+    // links are followed all the time
+    const QStringList alphabets = {"ab", "abc", QString::fromUtf16(u"a\u00e9\u8000")};
+
+    QRandomGenerator random(20261017);
+    for (const QString& alphabet : alphabets) {
+        for (int round = 0; round < 500; ++round) {
+            QStringList patterns;
+            int patternCount = random.bounded(1, 12);
+            for (int i = 0; i < patternCount; ++i) {
+                patterns.append(randomText(random, alphabet, random.bounded(0, 7)));
+            }
+            MultiPatternMatcher matcher(patterns);
+
+            for (int t = 0; t < 4; ++t) {
+                QString text = randomText(random, alphabet, random.bounded(0, 60));
+                QList<int> expected = bruteForce(patterns, text);
+                QVERIFY2(matcher.findIn(text) == expected,
+                         qPrintable(QStringLiteral("patterns \"%1\" in \"%2\"").arg(patterns.join("\", \""), text)));
+            }
+        }
+    }
+}
+
+void MultiPatternMatcherTest::testPatternCount()
+{
+    QCOMPARE(MultiPatternMatcher(QStringList()).patternCount(), 0);
+    QCOMPARE(MultiPatternMatcher(QStringList{"a", "", "a"}).patternCount(), 3);
+}
+
+QTEST_APPLESS_MAIN(MultiPatternMatcherTest)
+#include "multipatternmatchertest.moc"
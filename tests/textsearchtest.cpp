@@ -0,0 +1,163 @@
+// Checks the vectorized TextSearch kernels against the scalar one, and
+// case-folded search against QString's case-insensitive search.
+
+#include "document/textsearch.h"
+#include <QList>
+#include <QRandomGenerator>
+#include <QString>
+#include <QTest>
+#include <string>
+#include <string_view>
+#include <vector>
+
+class TextSearchTest : public QObject
+{
+    Q_OBJECT
+
+private slots:
+    void testKernelsAgree();
+    void testMatchAtEveryPosition();
+    void testEmptyAndOversizedNeedles();
+    void testCaseFoldedSearch_data();
+    void testCaseFoldedSearch();
+
+private:
+    static QList<TextSearch::Kernel> kernels();
+    static std::u16string randomText(QRandomGenerator& random, const std::u16string& alphabet, qsizetype size);
+    static void compareKernels(const std::u16string& haystack, const std::u16string& needle);
+};
+
+QList<TextSearch::Kernel> TextSearchTest::kernels()
+{
+    // AVX2 only runs where the CPU has it; the SSE kernel falls back to
+    // the scalar one on other architectures, so it is always safe to call
+    QList<TextSearch::Kernel> result = {TextSearch::Kernel::Scalar, TextSearch::Kernel::SSE};
+    if (TextSearch::kernel() == TextSearch::Kernel::AVX2) {
+        result.append(TextSearch::Kernel::AVX2);
+    }
+    return result;
+}
+
+std::u16string TextSearchTest::randomText(QRandomGenerator& random, const std::u16string& alphabet, qsizetype size)
+{
+    std::u16string text;
+    text.reserve(static_cast<size_t>(size));
+    for (qsizetype i = 0; i < size; ++i) {
+        text.push_back(alphabet[random.bounded(static_cast<int>(alphabet.size()))]);
+    }
+    return text;
+}
+
+void TextSearchTest::compareKernels(const std::u16string& haystack, const std::u16string& needle)
+{
+    size_t found = std::u16string_view(haystack).find(needle);
+    qsizetype expected = found == std::u16string_view::npos ? -1 : static_cast<qsizetype>(found);
+
+    for (TextSearch::Kernel kernel : kernels()) {
+        qsizetype actual = TextSearch::indexOf(kernel, haystack.data(), static_cast<qsizetype>(haystack.size()),
+                                               needle.data(), static_cast<qsizetype>(needle.size()));
+        QVERIFY2(actual == expected,
+                 qPrintable(QStringLiteral("kernel %1: found %2 instead of %3 for \"%4\" in \"%5\"")
+                                .arg(static_cast<int>(kernel))
+                                .arg(actual)
+                                .arg(expected)
+                                .arg(QString::fromStdU16String(needle), QString::fromStdU16String(haystack))));
+    }
+}
+
+void TextSearchTest::testKernelsAgree()
+{
+    // Small alphabets make first and last code units match often, so the
+    // candidate checks run; the second one has code units with the sign
+    // bit set, which a signed compare would get wrong
+    const std::vector<std::u16string> alphabets = {
+        u"ab",
+        u"a\u00e9\u8000\uffff",
+        u"abcdefghijklmnopqrstuvwxyz "
+    };
+
+    QRandomGenerator random(20261017);
+    for (const std::u16string& alphabet : alphabets) {
+        for (qsizetype size = 0; size <= 200; ++size) {
+            std::u16string haystack = randomText(random, alphabet, size);
+            for (int round = 0; round < 8; ++round) {
+                qsizetype needleSize = 1 + random.bounded(40);
+                std::u16string needle;
+                if (round % 2 == 0 && needleSize <= size) {
+                    // Cut from the text, so there is at least one match
+                    qsizetype start = random.bounded(static_cast<int>(size - needleSize + 1));
+                    needle = haystack.substr(static_cast<size_t>(start), static_cast<size_t>(needleSize));
+                } else {
+                    needle = randomText(random, alphabet, needleSize);
+                }
+
+                compareKernels(haystack, needle);
+                if (QTest::currentTestFailed()) {
+                    return;
+                }
+            }
+        }
+    }
+}
+
+void TextSearchTest::testMatchAtEveryPosition()
+{
+    // A single match anywhere, including across the end of a vector block
+    // and in the tail the kernels finish with a narrower loop
+    for (qsizetype size : {1, 7, 8, 9, 15, 16, 17, 31, 32, 33, 64, 100}) {
+        for (qsizetype needleSize : {1, 2, 3, 8, 16, 17}) {
+            if (needleSize > size) {
+                continue;
+            }
+            std::u16string needle(static_cast<size_t>(needleSize), u'x');
+            needle.back() = u'y';
+            for (qsizetype position = 0; position + needleSize <= size; ++position) {
+                std::u16string haystack(static_cast<size_t>(size), u'x');
+                haystack.replace(static_cast<size_t>(position), needle.size(), needle);
+
+                compareKernels(haystack, needle);
+                if (QTest::currentTestFailed()) {
+                    return;
+                }
+            }
+        }
+    }
+}
+
+void TextSearchTest::testEmptyAndOversizedNeedles()
+{
+    const std::u16string haystack = u"abc";
+    for (TextSearch::Kernel kernel : kernels()) {
+        QCOMPARE(TextSearch::indexOf(kernel, haystack.data(), 3, haystack.data(), 0), qsizetype(0));
+        QCOMPARE(TextSearch::indexOf(kernel, haystack.data(), 0, haystack.data(), 0), qsizetype(0));
+        QCOMPARE(TextSearch::indexOf(kernel, haystack.data(), 2, haystack.data(), 3), qsizetype(-1));
+        QCOMPARE(TextSearch::indexOf(kernel, haystack.data(), 3, haystack.data(), 3), qsizetype(0));
+    }
+}
+
+void TextSearchTest::testCaseFoldedSearch_data()
+{
+    QTest::addColumn<QString>("text");
+    QTest::addColumn<QString>("needle");
+
+    QTest::newRow("ascii") << "The Quick Brown Fox" << "QUICK brown";
+    QTest::newRow("ascii absent") << "The Quick Brown Fox" << "quick fox";
+    QTest::newRow("latin-1") << QString::fromUtf8("Grüße aus KÖLN") << QString::fromUtf8("köln");
+    QTest::newRow("greek") << QString::fromUtf8("ΣΟΦΙΑ και λόγος") << QString::fromUtf8("σοφια");
+    QTest::newRow("cyrillic") << QString::fromUtf8("Война и мир") << QString::fromUtf8("ВОЙНА");
+    QTest::newRow("whole text") << "Abc" << "aBC";
+    QTest::newRow("longer needle") << "abc" << "ABCD";
+}
+
+void TextSearchTest::testCaseFoldedSearch()
+{
+    QFETCH(QString, text);
+    QFETCH(QString, needle);
+
+    // Folding both sides once must find what a case-insensitive compare finds
+    QCOMPARE(TextSearch::contains(text.toCaseFolded(), needle.toCaseFolded()),
+             text.contains(needle, Qt::CaseInsensitive));
+}
+
+QTEST_APPLESS_MAIN(TextSearchTest)
+#include "textsearchtest.moc"